@@ -6,17 +6,29 @@
 //
 
 #include "application.hpp"
+#include <checkpoint.hpp>
 #include <clang_format.hpp>
 #include <cli_config.hpp>
+#include <corpus.hpp>
 #include <levenshtein.hpp>
-#include <boost/process.hpp>
+#include <process_reactor.hpp>
+#include <replacements.hpp>
+#include <whitespace_distance.hpp>
+#ifdef CLANG_UNFORMAT_HAS_LIBFORMAT
+#    include <libformat.hpp>
+#endif
+#include <boost/asio/post.hpp>
 #include <fmt/chrono.h>
 #include <fmt/color.h>
 #include <fmt/format.h>
+#include <fmt/ranges.h>
 #include <futures/futures.h>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <filesystem>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <numeric>
 #include <optional>
@@ -24,7 +36,21 @@
 #include <string_view>
 
 namespace fs = std::filesystem;
-namespace process = boost::process;
+
+namespace {
+    // Memory to remember the distances of the formatted outputs
+    constexpr std::size_t max_memo_bytes = 256 * 1024 * 1024;
+
+    // Memory for the bit masks of the files compared with their outputs
+    constexpr std::size_t max_pattern_bytes = 256 * 1024 * 1024;
+
+    // Memory for the outputs the values of a parameter change relative to
+    // the incumbent outputs
+    constexpr std::size_t max_candidate_bytes = 256 * 1024 * 1024;
+
+    // Memory for the distances of the files formatted with each style
+    constexpr std::size_t max_cache_bytes = 64 * 1024 * 1024;
+} // namespace
 
 application::application(int argc, char **argv)
     : config_(parse_cli(argc, argv)) {}
@@ -35,13 +61,54 @@ application::run() {
         print_help(program_description());
         return 1;
     }
+    build_corpus();
+    if (config_.backend == formatter_backend::process) {
+        reactor_ = std::make_unique<
+            process_reactor>(config_.clang_format, config_.max_children);
+        if (config_.evaluation == evaluation_mode::temp_directory) {
+            build_temp_slots();
+        }
+    }
+    probe_option_values();
     clang_format_local_search();
     inherit_undetermined_values();
     set_default_values();
     save(current_cf_, config_.output);
+    // The search is complete, so there's nothing left to resume
+    std::error_code ec;
+    fs::remove(checkpoint_path(), ec);
     return 0;
 }
 
+void
+application::build_corpus() {
+    fmt::print(fmt::fg(fmt::terminal_color::blue), "## Scanning input\n");
+    corpus_ = corpus(config_.input, config_.extensions);
+    fmt::print(
+        fmt::fg(fmt::terminal_color::green),
+        "{} files ({} bytes) to format\n",
+        corpus_.files().size(),
+        corpus_.total_size());
+    fmt::print("\n");
+    memo_ = std::make_unique<
+        distance_memo>(corpus_.files().size(), max_memo_bytes);
+    incumbent_ = std::make_unique<incumbent_outputs>(corpus_.files().size());
+    cache_ = std::make_unique<format_cache>(max_cache_bytes);
+    // Distances depend on the formatter, the metric, and on whether whole
+    // files or replacements are compared
+    formatter_hash_ = content_hash(fmt::format(
+        "{}\n{}\n{}",
+        config_.clang_format_full_version,
+        static_cast<int>(config_.metric),
+        static_cast<int>(config_.evaluation)));
+    if (!config_.cache.empty()) {
+        disk_ = std::make_unique<
+            disk_cache>(config_.cache, config_.cache_size * 1024 * 1024);
+    }
+    patterns_.resize(corpus_.files().size());
+    upper_bound_files_.resize(corpus_.files().size());
+}
+
 inline std::string
 pretty_time(std::chrono::steady_clock::duration d) {
     auto mc = std::chrono::duration_cast<std::chrono::microseconds>(d);
@@ -62,63 +129,691 @@ pretty_time(std::chrono::steady_clock::duration d) {
     }
 }
 
+namespace {
+    // Print the output of clang-format after formatting files in place
+    void
+    print_clang_format_errors(std::string_view output) {
+        if (output.empty()) {
+            return;
+        }
+        fmt::print(fmt::fg(fmt::terminal_color::red), "clang-format error!\n");
+        fmt::print(fmt::fg(fmt::terminal_color::red), "{}\n", output);
+    }
+
+    // Distance of a candidate whose evaluation ran out of time
+    constexpr std::size_t timed_out_distance = std::size_t(-2);
+
+    // Distance of a candidate pruned because another value is closer
+    constexpr std::size_t pruned_distance = std::size_t(-3);
+} // namespace
+
+// State of a candidate evaluated in a temp directory
+struct application::temp_evaluation {
+    std::string style;
+    std::shared_ptr<process_reactor::time_budget> budget;
+    std::optional<temp_slots::lease> slot;
+    std::vector<std::vector<std::string>> batches;
+    std::size_t next_batch{ 0 };
+    // First file of the next batch
+    std::size_t next_file{ 0 };
+    std::size_t total_distance{ 0 };
+    std::shared_ptr<candidate_outputs> outputs;
+    std::promise<std::size_t> result;
+};
+
+// State of a candidate evaluated in memory
+struct application::in_memory_evaluation {
+    std::shared_ptr<process_reactor::time_budget> budget;
+    std::atomic<std::size_t> remaining{ 0 };
+    std::atomic<std::size_t> total_distance{ 0 };
+    std::atomic<bool> failed{ false };
+    std::atomic<bool> timed_out{ false };
+    std::atomic<bool> pruned{ false };
+    std::shared_ptr<candidate_outputs> outputs;
+    std::promise<std::size_t> result;
+
+    // Account for a file whose evaluation is complete
+    void
+    finish_file(application &app) {
+        if (--remaining != 0) {
+            return;
+        }
+        // Files of pruned candidates are killed as if they timed out
+        if (failed) {
+            result.set_value(std::size_t(-1));
+        } else if (pruned) {
+            result.set_value(pruned_distance);
+        } else if (timed_out) {
+            result.set_value(timed_out_distance);
+        } else {
+            app.record_distance(total_distance);
+            result.set_value(total_distance.load());
+        }
+    }
+};
+
+std::vector<std::vector<std::string>>
+application::temp_directory_batches(const fs::path &task_temp) const {
+    // Split the files into batches limited by file count and size
+    std::vector<std::vector<std::string>> batches;
+    std::uintmax_t batch_bytes = 0;
+    fs::path const abs_task_temp = fs::absolute(task_temp);
+    for (corpus_file const &f: corpus_.files()) {
+        bool const batch_full = batches.empty()
+                                || batches.back().size() >= config_.batch_files
+                                || batch_bytes + f.size > config_.batch_bytes;
+        if (batch_full) {
+            batches.emplace_back();
+            batch_bytes = 0;
+        }
+        batches.back().emplace_back((abs_task_temp / f.relative).string());
+        batch_bytes += f.size;
+    }
+    return batches;
+}
+
+std::vector<std::string>
+application::format_files_args(
+    const std::vector<std::string> &files,
+    std::string const &style) {
+    std::vector<std::string> args;
+    args.reserve(files.size() + 2);
+    args.emplace_back(fmt::format("--style={}", style));
+    args.emplace_back("-i");
+    args.insert(args.end(), files.begin(), files.end());
+    return args;
+}
+
 bool
-application::format_temp_directory(const fs::path &task_temp) {
-    auto begin = fs::recursive_directory_iterator(task_temp);
-    auto end = fs::recursive_directory_iterator{};
-    for (auto it = begin; it != end; ++it) {
-        fs::path p = it->path();
-        if (!should_format(p)) {
-            continue;
-        }
-        process::ipstream is;
-        process::child
-            c(config_.clang_format.c_str(),
-              "-i",
-              fs::absolute(p).c_str(),
-              process::std_out > is,
-              process::std_err > process::null);
-        std::string line;
-        bool first_error_line = true;
-        while (c.running() && std::getline(is, line) && !line.empty()) {
-            if (first_error_line) {
+application::format_files(
+    const std::vector<std::string> &files,
+    std::string const &style) {
+    auto [exit_code, output] = reactor_->run(format_files_args(files, style));
+    print_clang_format_errors(output);
+    return exit_code == 0;
+}
+
+void
+application::report_failed_batch(
+    const std::vector<std::string> &batch,
+    std::string const &style) {
+    // Attribute the failure to a file. If the first file fails on its
+    // own, the option value itself is not supported and the candidate
+    // is silently skipped.
+    if (batch.size() > 1 && format_files({ batch.front() }, style)) {
+        for (auto const &file: batch) {
+            if (!format_files({ file }, style)) {
                 fmt::print(
                     fmt::fg(fmt::terminal_color::red),
-                    "clang-format error!\n");
-                first_error_line = false;
+                    "clang-format cannot format {}\n",
+                    file);
+                break;
             }
-            fmt::print(fmt::fg(fmt::terminal_color::red), "{}\n", line);
-        }
-        c.wait();
-        if (c.exit_code() != 0) {
-            return false;
         }
     }
-    return true;
 }
 
 std::size_t
-application::distance_formatted_files(const fs::path &task_temp) {
+application::distance_formatted_files(
+    temp_slots::lease &slot,
+    std::size_t first,
+    std::size_t last,
+    std::size_t accumulated,
+    candidate_outputs &outputs) {
     std::size_t total_distance = 0;
-    auto begin = fs::recursive_directory_iterator(config_.input);
-    auto end = fs::recursive_directory_iterator{};
-    for (auto it = begin; it != end; ++it) {
-        fs::path p = it->path();
-        if (should_format(p)) {
-            fs::path input_relative = fs::relative(p, config_.input);
-            fs::path output_relative = task_temp / input_relative;
-            total_distance += levenshtein_distance(p, output_relative);
+    bool exceeded = false;
+    for (std::size_t i = first; i < last; ++i) {
+        corpus_file const &f = corpus_.files()[i];
+        std::ifstream fin(slot.path() / f.relative, std::ios::binary);
+        std::string
+            formatted((std::istreambuf_iterator<char>(fin)),
+                      std::istreambuf_iterator<char>());
+        // Changed files still need to be restored after the bound is exceeded
+        if (f.content != formatted) {
+            slot.mark_changed(i);
+        }
+        if (!exceeded) {
+            std::size_t d = bounded_distance(
+                i,
+                formatted,
+                accumulated + total_distance,
+                outputs);
+            exceeded = d == std::size_t(-1);
+            total_distance += exceeded ? 0 : d;
         }
     }
+    // Another value might have become closer while the files were formatted
+    if (exceeded || accumulated + total_distance > best_distance_) {
+        return std::size_t(-1);
+    }
     return total_distance;
 }
 
 std::size_t
-application::evaluate(const fs::path &task_temp) {
-    if (!format_temp_directory(task_temp)) {
+application::bounded_distance(
+    std::size_t file,
+    std::string_view formatted,
+    std::size_t accumulated,
+    candidate_outputs &outputs) const {
+    std::size_t const best = best_distance_;
+    if (best != std::size_t(-1) && accumulated > best) {
+        return std::size_t(-1);
+    }
+    std::string_view const original = corpus_.files()[file].content;
+    if (formatted == original) {
+        if (!incumbent_->is_original(file)) {
+            outputs.record(file, std::nullopt, 0);
+        } else {
+            outputs.record_distance(file, 0);
+        }
+        return 0;
+    }
+
+    // Most values don't change the incumbent output of a file
+    std::size_t const bound = best == std::size_t(-1) ? best
+                                                       : best - accumulated;
+    if (std::optional<std::size_t> known = incumbent_->find(file, formatted))
+    {
+        if (*known > bound) {
+            return std::size_t(-1);
+        }
+        outputs.record_distance(file, *known);
+        return *known;
+    }
+
+    // Reuse the distance of an identical output scored before
+    std::size_t d = std::size_t(-1);
+    if (std::optional<std::size_t> known = memo_->find(file, formatted)) {
+        d = *known <= bound ? *known : std::size_t(-1);
+    } else {
+        d = metric_distance(original, formatted, bound, file);
+        if (d != std::size_t(-1)) {
+            memo_->insert(file, formatted, d);
+        }
+    }
+    if (d != std::size_t(-1)) {
+        outputs.record(file, formatted, d);
+    }
+    return d;
+}
+
+std::size_t
+application::bounded_replacements_distance(
+    std::size_t file,
+    std::vector<replacement> const &changes,
+    std::size_t accumulated,
+    candidate_outputs &outputs) const {
+    std::size_t const best = best_distance_;
+    if (best != std::size_t(-1) && accumulated > best) {
+        return std::size_t(-1);
+    }
+    std::string_view const original = corpus_.files()[file].content;
+    std::size_t const bound = best == std::size_t(-1) ? best
+                                                       : best - accumulated;
+    std::size_t total = 0;
+    for (replacement const &r: changes) {
+        std::size_t d = metric_distance(
+            original.substr(r.offset, r.length),
+            r.text,
+            bound == std::size_t(-1) ? bound : bound - total,
+            file);
+        if (d == std::size_t(-1)) {
+            return d;
+        }
+        total += d;
+    }
+    outputs.record_distance(file, total);
+    return total;
+}
+
+std::size_t
+application::metric_distance(
+    std::string_view original,
+    std::string_view formatted,
+    std::size_t bound,
+    std::size_t file) const {
+    if (config_.metric == distance_metric::whitespace) {
+        if (std::optional<std::size_t> d = whitespace_distance(
+                original,
+                formatted))
+        {
+            return *d <= bound ? *d : std::size_t(-1);
+        }
+    }
+    std::string_view const content = corpus_.files()[file].content;
+    if (original.data() == content.data() && original.size() == content.size())
+    {
+        auto pattern = file_pattern(file);
+        if (pattern->bit_parallel()) {
+            return pattern->distance(formatted, bound);
+        }
+    }
+    // Very large files are split between the threads of the pool, which
+    // share the memory limit
+    std::size_t const max_bytes = config_.align_memory == 0
+                                      ? std::size_t(-1)
+                                      : config_.align_memory * 1024 * 1024
+                                            / config_.parallel;
+    levenshtein_estimate const d = estimate_levenshtein_distance(
+        original,
+        formatted,
+        bound,
+        max_bytes,
+        spawn_,
+        config_.parallel);
+    if (d.upper_bound) {
+        ++upper_bound_distances_;
+        std::lock_guard<std::mutex> lock(upper_bound_mutex_);
+        upper_bound_files_[file] = true;
+    }
+    return d.distance;
+}
+
+std::shared_ptr<levenshtein_pattern const>
+application::file_pattern(std::size_t file) const {
+    {
+        std::lock_guard<std::mutex> lock(patterns_mutex_);
+        if (patterns_[file]) {
+            return patterns_[file];
+        }
+    }
+    // Patterns that don't fit in memory are built again when needed
+    auto pattern = std::make_shared<levenshtein_pattern const>(
+        corpus_.files()[file].content);
+    std::lock_guard<std::mutex> lock(patterns_mutex_);
+    if (!patterns_[file]
+        && pattern_bytes_ + pattern->bytes() <= max_pattern_bytes)
+    {
+        patterns_[file] = pattern;
+        pattern_bytes_ += pattern->bytes();
+    }
+    return pattern;
+}
+
+void
+application::record_distance(std::size_t distance) {
+    std::size_t best = best_distance_;
+    while (distance < best
+           && !best_distance_.compare_exchange_weak(best, distance))
+    {}
+}
+
+std::future<std::size_t>
+application::evaluate(
+    const boost::asio::thread_pool::executor_type &ex,
+    std::string style,
+    std::shared_ptr<candidate_outputs> outputs) {
+    auto e = std::make_shared<temp_evaluation>();
+    e->style = std::move(style);
+    e->outputs = std::move(outputs);
+    e->budget = candidate_budget();
+    std::future<std::size_t> result = e->result.get_future();
+    slots_->async_acquire([this, ex, e](temp_slots::lease slot) {
+        e->batches = temp_directory_batches(slot.path());
+        e->slot.emplace(std::move(slot));
+        format_next_batch(ex, e);
+    });
+    return result;
+}
+
+void
+application::format_next_batch(
+    const boost::asio::thread_pool::executor_type &ex,
+    std::shared_ptr<temp_evaluation> const &e) {
+    if (e->next_batch == e->batches.size()) {
+        record_distance(e->total_distance);
+        e->slot.reset();
+        e->result.set_value(e->total_distance);
+        return;
+    }
+    std::vector<std::string> const &batch = e->batches[e->next_batch];
+    reactor_->async_run(
+        format_files_args(batch, e->style),
+        {},
+        [this, ex, e](int exit_code, std::string output) {
+        if (exit_code == process_reactor::timed_out) {
+            boost::asio::post(ex, [e] {
+                e->slot->mark_all_changed();
+                e->slot.reset();
+                e->result.set_value(timed_out_distance);
+            });
+            return;
+        }
+        print_clang_format_errors(output);
+        if (exit_code == 0) {
+            // Calculate the distance of the batch on the pool and stop as
+            // soon as another value is closer
+            boost::asio::post(ex, [this, ex, e] {
+                std::size_t const first = e->next_file;
+                std::size_t const last = first
+                                         + e->batches[e->next_batch].size();
+                std::size_t d = distance_formatted_files(
+                    *e->slot,
+                    first,
+                    last,
+                    e->total_distance,
+                    *e->outputs);
+                if (d == std::size_t(-1)) {
+                    e->slot.reset();
+                    e->result.set_value(pruned_distance);
+                    return;
+                }
+                e->total_distance += d;
+                e->next_file = last;
+                ++e->next_batch;
+                format_next_batch(ex, e);
+            });
+            return;
+        }
+        boost::asio::post(ex, [this, e] {
+            report_failed_batch(e->batches[e->next_batch], e->style);
+            e->slot->mark_all_changed();
+            e->slot.reset();
+            e->result.set_value(std::size_t(-1));
+        });
+        },
+        file_timeout() * static_cast<int>(batch.size()),
+        e->budget);
+}
+
+bool
+application::clang_format_replaces_files() {
+    // Format a file with a hardlink and check if the link was broken
+    fs::path probe_dir = config_.temp / "hardlink_probe";
+    fs::create_directories(probe_dir);
+    fs::path probe = probe_dir / "probe.cpp";
+    fs::path link = probe_dir / "link.cpp";
+    {
+        std::ofstream fout(probe);
+        fout << "int   x;\n";
+    }
+    std::error_code ec;
+    fs::create_hard_link(probe, link, ec);
+    bool replaces = false;
+    if (!ec && format_files({ probe.string() }, "{BasedOnStyle: LLVM}")) {
+        replaces = !fs::equivalent(probe, link, ec) && !ec;
+    }
+    fs::remove_all(probe_dir, ec);
+    return replaces;
+}
+
+void
+application::build_temp_slots() {
+    fmt::print(fmt::fg(fmt::terminal_color::blue), "## Preparing temp\n");
+    bool const hardlinks = clang_format_replaces_files();
+    if (hardlinks) {
+        fmt::print(
+            fmt::fg(fmt::terminal_color::green),
+            "clang-format replaces formatted files: temp files are "
+            "hardlinks to the input files\n");
+    } else {
+        fmt::print(
+            fmt::fg(fmt::terminal_color::yellow),
+            "clang-format writes to formatted files: temp files are "
+            "copies of the input files\n");
+    }
+    slots_ = std::make_unique<
+        temp_slots>(corpus_, config_.temp, config_.max_children, hardlinks);
+    fmt::print("\n");
+}
+
+std::future<std::size_t>
+application::evaluate_in_memory(
+    const boost::asio::thread_pool::executor_type &ex,
+    std::string const &style,
+    std::shared_ptr<candidate_outputs> outputs) {
+    auto e = std::make_shared<in_memory_evaluation>();
+    e->outputs = std::move(outputs);
+    std::future<std::size_t> result = e->result.get_future();
+    e->budget = candidate_budget();
+    e->remaining = corpus_.files().size();
+    if (corpus_.files().empty()) {
+        e->result.set_value(0);
+        return result;
+    }
+    for (std::size_t i = 0; i < corpus_.files().size(); ++i) {
+        corpus_file const &f = corpus_.files()[i];
+        std::vector<std::string> args{
+            fmt::format("--style={}", style),
+            fmt::format(
+                "--assume-filename={}",
+                (corpus_.input() / f.relative).string())
+        };
+        if (config_.evaluation == evaluation_mode::replacements) {
+            args.emplace_back("--output-replacements-xml");
+        }
+        reactor_->async_run(
+            std::move(args),
+            f.content,
+            [this, ex, e, i](int exit_code, std::string formatted) {
+            if (exit_code == process_reactor::timed_out) {
+                e->timed_out = true;
+                e->finish_file(*this);
+                return;
+            }
+            if (exit_code != 0) {
+                e->failed = true;
+                e->finish_file(*this);
+                return;
+            }
+            // Calculate the distance on the pool
+            boost::asio::post(
+                ex,
+                [this, e, i, formatted = std::move(formatted)] {
+                if (e->failed || e->pruned) {
+                    e->finish_file(*this);
+                    return;
+                }
+                std::size_t d = 0;
+                if (config_.evaluation == evaluation_mode::replacements) {
+                    std::optional<std::vector<replacement>>
+                        changes = parse_replacements_xml(
+                            formatted,
+                            corpus_.files()[i].content.size());
+                    if (!changes) {
+                        e->failed = true;
+                        e->finish_file(*this);
+                        return;
+                    }
+                    d = bounded_replacements_distance(
+                        i,
+                        *changes,
+                        e->total_distance,
+                        *e->outputs);
+                } else {
+                    d = bounded_distance(
+                        i,
+                        formatted,
+                        e->total_distance,
+                        *e->outputs);
+                }
+                if (d == std::size_t(-1)) {
+                    // Stop the other files of the candidate
+                    if (!e->pruned.exchange(true)) {
+                        reactor_->cancel(e->budget);
+                    }
+                } else {
+                    e->total_distance += d;
+                }
+                e->finish_file(*this);
+                });
+            },
+            file_timeout(),
+            e->budget);
+    }
+    return result;
+}
+
+#ifdef CLANG_UNFORMAT_HAS_LIBFORMAT
+std::size_t
+application::evaluate_libformat(
+    std::string const &inline_cf,
+    candidate_outputs &outputs) {
+    // Parse the candidate style once for all files
+    std::optional<libformat_style> style = libformat_style::parse(inline_cf);
+    if (!style) {
         return std::size_t(-1);
     }
-    return distance_formatted_files(task_temp);
+    std::size_t total_distance = 0;
+    for (std::size_t i = 0; i < corpus_.files().size(); ++i) {
+        corpus_file const &f = corpus_.files()[i];
+        std::optional<std::string> formatted = style->format(
+            f.content,
+            (corpus_.input() / f.relative).string());
+        if (!formatted) {
+            return std::size_t(-1);
+        }
+        std::size_t d = bounded_distance(
+            i,
+            *formatted,
+            total_distance,
+            outputs);
+        if (d == std::size_t(-1)) {
+            return pruned_distance;
+        }
+        total_distance += d;
+    }
+    record_distance(total_distance);
+    return total_distance;
+}
+#endif
+
+std::chrono::steady_clock::duration
+application::file_timeout() const {
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        config_.file_timeout);
+}
+
+std::shared_ptr<process_reactor::time_budget>
+application::candidate_budget() const {
+    return std::make_shared<process_reactor::time_budget>(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            config_.candidate_timeout));
+}
+
+std::vector<std::optional<std::uint64_t>>
+application::effective_style_hashes(std::vector<std::string> const &styles) {
+    std::vector<std::optional<std::uint64_t>> hashes(styles.size());
+#ifdef CLANG_UNFORMAT_HAS_LIBFORMAT
+    if (config_.backend == formatter_backend::libformat) {
+        for (std::size_t i = 0; i < styles.size(); ++i) {
+            if (std::optional<libformat_style> style = libformat_style::parse(
+                    styles[i]))
+            {
+                hashes[i] = content_hash(style->dump());
+            }
+        }
+        return hashes;
+    }
+#endif
+
+    // clang-format prints the effective styles without formatting any file
+    std::vector<std::promise<std::optional<std::uint64_t>>> dumped(
+        styles.size());
+    for (std::size_t i = 0; i < styles.size(); ++i) {
+        reactor_->async_run(
+            { "--dump-config", fmt::format("--style={}", styles[i]) },
+            {},
+            [&dumped, i](int exit_code, std::string output) {
+            if (exit_code == 0) {
+                dumped[i].set_value(content_hash(output));
+            } else {
+                dumped[i].set_value(std::nullopt);
+            }
+            },
+            file_timeout());
+    }
+    for (std::size_t i = 0; i < styles.size(); ++i) {
+        hashes[i] = dumped[i].get_future().get();
+    }
+    return hashes;
+}
+
+format_cache::key
+application::cache_key(std::uint64_t style, std::size_t file) const {
+    // The output also depends on the file name, as in the main include
+    corpus_file const &f = corpus_.files()[file];
+    std::uint64_t const name = content_hash(f.relative.generic_string());
+    format_cache::key k;
+    k.style = style;
+    k.file = f.hash ^ (name * 1099511628211ull);
+    k.version = formatter_hash_;
+    return k;
+}
+
+std::optional<std::size_t>
+application::cached_distance(std::uint64_t style) {
+    // Distances stored by previous runs are loaded once for each style
+    if (disk_ && loaded_styles_.insert(style).second) {
+        format_cache::key k;
+        k.style = style;
+        k.version = formatter_hash_;
+        for (auto const &[file, distance]: disk_->load(style, formatter_hash_))
+        {
+            k.file = file;
+            cache_->insert(k, distance);
+        }
+    }
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < corpus_.files().size(); ++i) {
+        std::optional<std::size_t> d = cache_->find(cache_key(style, i));
+        if (!d) {
+            return std::nullopt;
+        }
+        total += *d;
+    }
+    return total;
+}
+
+void
+application::cache_distances(
+    std::uint64_t style,
+    candidate_outputs const &outputs) {
+    std::vector<std::size_t> const distances = outputs.distances();
+    std::vector<bool> upper_bound_files;
+    {
+        std::lock_guard<std::mutex> lock(upper_bound_mutex_);
+        upper_bound_files = upper_bound_files_;
+    }
+    std::vector<disk_cache::entry> entries;
+    for (std::size_t i = 0; i < distances.size(); ++i) {
+        if (distances[i] != std::size_t(-1)) {
+            format_cache::key const k = cache_key(style, i);
+            cache_->insert(k, distances[i]);
+            // Upper bounds depend on the memory limit of this run
+            if (!upper_bound_files[i]) {
+                entries.emplace_back(k.file, distances[i]);
+            }
+        }
+    }
+    if (disk_) {
+        disk_->store(style, formatter_hash_, entries);
+    }
+}
+
+std::future<std::size_t>
+application::evaluate_candidate(
+    const boost::asio::thread_pool::executor_type &ex,
+    std::string style,
+    std::shared_ptr<candidate_outputs> outputs) {
+#ifdef CLANG_UNFORMAT_HAS_LIBFORMAT
+    if (config_.backend == formatter_backend::libformat) {
+        auto result = std::make_shared<std::promise<std::size_t>>();
+        boost::asio::post(
+            ex,
+            [this, result, style = std::move(style), outputs] {
+            result->set_value(evaluate_libformat(style, *outputs));
+            });
+        return result->get_future();
+    }
+#endif
+
+    if (config_.evaluation != evaluation_mode::temp_directory) {
+        return evaluate_in_memory(ex, style, std::move(outputs));
+    }
+
+    // Evaluate in a temp directory with the original files
+    return evaluate(ex, std::move(style), std::move(outputs));
 }
 
 // Apply requirements to option
@@ -148,6 +843,7 @@ void
 application::print_time_stats(
     std::chrono::steady_clock::duration total_evaluation_time,
     std::size_t total_neighbors_evaluated,
+    std::size_t total_timeouts,
     std::size_t total_neighbors) const {
     if (!current_cf_.empty() && total_evaluation_time > std::chrono::seconds(1))
     {
@@ -170,6 +866,13 @@ application::print_time_stats(
         fmt::print(
             "# Estimated time left: {}\n",
             pretty_time(est_evaluation_time));
+        if (total_timeouts) {
+            // Time spent on values that timed out is part of the average
+            fmt::print(
+                fmt::fg(fmt::terminal_color::yellow),
+                "# Timed out: {} parameter values\n",
+                total_timeouts);
+        }
         fmt::print("==============================\n\n");
     }
 };
@@ -180,6 +883,7 @@ application::evaluate_option_values(
     const boost::asio::thread_pool::executor_type &ex,
     std::size_t &closest_edit_distance,
     std::size_t &total_neighbors_evaluated,
+    std::size_t &total_timeouts,
     std::string const &key,
     clang_format_possible_values const &possible_values) {
     // Options table header
@@ -208,46 +912,72 @@ application::evaluate_option_values(
         }
         fmt::print("│\n");
 
-        // Launch evaluation tasks
-        std::vector<futures::cfuture<std::size_t>> evaluation_tasks;
-        for (std::size_t i = 0; i < possible_values.options.size(); ++i) {
-            const auto &possible_value = *(
-                possible_values.options.begin()
-                + static_cast<std::vector<std::string>::difference_type>(i));
-            evaluation_tasks.emplace_back(futures::async(
-                ex,
-                [this,
-                 i,
-                 current_cf = current_cf_,
-                 possible_value,
-                 key = key,
-                 empty_str]() mutable {
-                // Copy experiment files
-                fs::path task_temp = config_.temp / fmt::format("temp_{}", i);
-                fs::copy(
-                    config_.input,
-                    task_temp,
-                    fs::copy_options::recursive
-                        | fs::copy_options::overwrite_existing);
-
-                // Emplace option in clang format
-                current_cf.emplace_back(clang_format_entry{
-                    key,
-                    possible_value,
-                    true,
-                    0,
-                    false,
-                    empty_str });
-                save(current_cf, task_temp / ".clang-format");
+        // Launch evaluation tasks, which stop calculating distances once
+        // they cannot be closer than the closest value
+        best_distance_ = closest_edit_distance;
+        std::size_t const prev_upper_bounds = upper_bound_distances_;
+        std::vector<std::string> styles;
+        for (const auto &possible_value: possible_values.options) {
+            // Emplace option in clang format
+            std::vector<clang_format_entry> current_cf = current_cf_;
+            current_cf.emplace_back(clang_format_entry{
+                key,
+                possible_value,
+                true,
+                0,
+                false,
+                empty_str });
+            styles.emplace_back(inline_style(current_cf));
+        }
 
-                // Evaluate
-                std::size_t dist = evaluate(task_temp);
-                return dist;
-                }));
+        // Values with the same effective style as a value evaluated before
+        // reuse its distances instead of formatting the files again
+        std::vector<std::optional<std::uint64_t>> const style_hashes
+            = effective_style_hashes(styles);
+        std::vector<std::shared_future<std::size_t>> evaluation_tasks;
+        std::vector<std::shared_ptr<candidate_outputs>> outputs;
+        std::vector<bool> reused(styles.size(), false);
+        for (std::size_t i = 0; i < styles.size(); ++i) {
+            std::optional<std::uint64_t> const &h = style_hashes[i];
+            auto same_style = std::find(
+                style_hashes.begin(),
+                style_hashes.begin() + i,
+                h);
+            if (h && same_style != style_hashes.begin() + i) {
+                std::size_t const j = same_style - style_hashes.begin();
+                evaluation_tasks.emplace_back(evaluation_tasks[j]);
+                outputs.emplace_back(outputs[j]);
+                reused[i] = true;
+                continue;
+            }
+            outputs.emplace_back(std::make_shared<candidate_outputs>(
+                corpus_.files().size(),
+                max_candidate_bytes / styles.size()));
+            std::optional<std::size_t> cached;
+            if (h && h == closest_style_) {
+                // The value clang-format already uses scores as the closest
+                // value of the previous parameter
+                cached = closest_distance_;
+            } else if (h) {
+                cached = cached_distance(*h);
+            }
+            if (cached) {
+                record_distance(*cached);
+                std::promise<std::size_t> known;
+                known.set_value(*cached);
+                evaluation_tasks.emplace_back(known.get_future());
+                reused[i] = true;
+            } else {
+                evaluation_tasks.emplace_back(
+                    evaluate_candidate(ex, styles[i], outputs.back()));
+            }
         }
 
         // Get and analyse results for parameter
         bool skipped_any = false;
+        bool timed_out_any = false;
+        std::shared_ptr<candidate_outputs> closest_outputs;
+        std::size_t closest_value = 0;
         fmt::print("│{0: ^{1}}", "Edit distance", first_col_w);
         for (std::size_t i = 0; i < possible_values.options.size(); ++i) {
             const auto &possible_value = possible_values.options[i];
@@ -258,8 +988,30 @@ application::evaluate_option_values(
 
             // Print some info
             std::size_t dist = evaluation_tasks[i].get();
+            bool const complete = dist != std::size_t(-1)
+                                  && dist != timed_out_distance
+                                  && dist != pruned_distance;
+            if (complete && style_hashes[i] && !reused[i]) {
+                cache_distances(*style_hashes[i], *outputs[i]);
+            }
             std::size_t col_w = (std::max)(possible_value.size() + 2, min_col_w);
-            if (dist == std::size_t(-1)) {
+            if (dist == timed_out_distance) {
+                fmt::print(
+                    fmt::fg(fmt::terminal_color::yellow),
+                    "{0: ^{1}}",
+                    "timeout",
+                    col_w);
+                timed_out_any = true;
+                ++total_timeouts;
+            } else if (dist == pruned_distance) {
+                // Some other value is closer than this one
+                fmt::print(
+                    fmt::fg(fmt::terminal_color::bright_red),
+                    "{0: ^{1}}",
+                    "pruned",
+                    col_w);
+                value_influenced_output = true;
+            } else if (dist == std::size_t(-1)) {
                 fmt::print(
                     fmt::fg(fmt::terminal_color::yellow),
                     "{0: ^{1}}",
@@ -296,6 +1048,8 @@ application::evaluate_option_values(
                 if (improved) {
                     closest_edit_distance = dist;
                     improvement_value = possible_value;
+                    closest_outputs = outputs[i];
+                    closest_value = i;
                 }
             }
             std::cout << std::flush;
@@ -303,6 +1057,14 @@ application::evaluate_option_values(
         }
         fmt::print("│\n");
 
+        // The next parameters only align the files they change relative to
+        // the closest value
+        if (closest_outputs) {
+            incumbent_->adopt(std::move(*closest_outputs));
+            closest_style_ = style_hashes[closest_value];
+            closest_distance_ = closest_edit_distance;
+        }
+
         // table footer
         fmt::print("└{0:─^{1}}", empty_str, first_col_w);
         for (const auto &option: possible_values.options) {
@@ -320,6 +1082,19 @@ application::evaluate_option_values(
                 "{}\n",
                 config_.clang_format_version);
         }
+        if (timed_out_any) {
+            fmt::print(
+                fmt::fg(fmt::terminal_color::yellow),
+                "Skipped option and value pairs clang-format could not "
+                "evaluate in time\n");
+        }
+        if (upper_bound_distances_ != prev_upper_bounds) {
+            fmt::print(
+                fmt::fg(fmt::terminal_color::yellow),
+                "Some distances are upper bounds of files too large for "
+                "{} MB\n",
+                config_.align_memory);
+        }
 
         // Update the main file
         if (!improvement_value.empty() && value_influenced_output) {
@@ -372,6 +1147,201 @@ application::evaluate_option_values(
     fmt::print("\n");
 };
 
+void
+application::probe_option_values() {
+    fmt::print(fmt::fg(fmt::terminal_color::blue), "## Probing options\n");
+    std::vector<std::string> styles;
+    for (const auto &[key, possible_values]: cf_opts_) {
+        for (const auto &possible_value: possible_values.options) {
+            std::vector<clang_format_entry> probe;
+            probe.emplace_back(clang_format_entry{
+                key,
+                possible_value,
+                true,
+                0,
+                false,
+                std::string{} });
+            styles.emplace_back(inline_style(probe));
+        }
+    }
+
+    // clang-format rejects the styles with keys or values it doesn't know
+    std::vector<bool> const accepted = accepted_styles(styles);
+    std::size_t i = 0;
+    std::size_t dropped = 0;
+    for (auto &[key, possible_values]: cf_opts_) {
+        std::vector<std::string> supported;
+        std::vector<std::string> unsupported;
+        for (auto &possible_value: possible_values.options) {
+            if (accepted[i++]) {
+                supported.emplace_back(std::move(possible_value));
+            } else {
+                unsupported.emplace_back(std::move(possible_value));
+            }
+        }
+        possible_values.options = std::move(supported);
+        if (!unsupported.empty()) {
+            // The default might have been one of the unsupported values
+            possible_values.default_value = reasonable_default_value(
+                key,
+                possible_values.options);
+            fmt::print(
+                fmt::fg(fmt::terminal_color::yellow),
+                "Skipping {} values not supported by clang-format {}: {}\n",
+                key,
+                config_.clang_format_version,
+                fmt::join(unsupported, ", "));
+            dropped += unsupported.size();
+        }
+    }
+    cf_opts_.erase(
+        std::remove_if(
+            cf_opts_.begin(),
+            cf_opts_.end(),
+            [](auto const &p) { return p.second.options.empty(); }),
+        cf_opts_.end());
+    if (dropped == 0) {
+        fmt::print(
+            fmt::fg(fmt::terminal_color::green),
+            "All option values are supported by clang-format {}\n",
+            config_.clang_format_version);
+    }
+    fmt::print("\n");
+}
+
+std::vector<bool>
+application::accepted_styles(std::vector<std::string> const &styles) {
+    std::vector<bool> accepted(styles.size(), true);
+#ifdef CLANG_UNFORMAT_HAS_LIBFORMAT
+    if (config_.backend == formatter_backend::libformat) {
+        for (std::size_t i = 0; i < styles.size(); ++i) {
+            accepted[i] = libformat_style::parse(styles[i]).has_value();
+        }
+        return accepted;
+    }
+#endif
+
+    // Only an error reported by clang-format itself rejects a style, while
+    // timeouts and children that could not run leave it in the search
+    std::vector<std::promise<bool>> checked(styles.size());
+    for (std::size_t i = 0; i < styles.size(); ++i) {
+        reactor_->async_run(
+            { "--dump-config", fmt::format("--style={}", styles[i]) },
+            {},
+            [&checked, i](int exit_code, std::string) {
+            checked[i].set_value(exit_code <= 0);
+            },
+            file_timeout());
+    }
+    for (std::size_t i = 0; i < styles.size(); ++i) {
+        accepted[i] = checked[i].get_future().get();
+    }
+    return accepted;
+}
+
+fs::path
+application::checkpoint_path() const {
+    fs::path p = config_.output;
+    p += ".checkpoint";
+    return p;
+}
+
+void
+application::identify_search(search_checkpoint &checkpoint) const {
+    checkpoint.formatter_hash = formatter_hash_;
+    checkpoint.input = fs::absolute(config_.input).lexically_normal().string();
+    std::string files;
+    for (corpus_file const &f: corpus_.files()) {
+        files += fmt::format("{}\n{}\n", f.relative.generic_string(), f.hash);
+    }
+    checkpoint.corpus_hash = content_hash(files);
+    std::string options;
+    for (auto const &[key, possible_values]: cf_opts_) {
+        options += fmt::format(
+            "{}\n{}\n{}\n{}\n{}\n{}\n",
+            key,
+            fmt::join(possible_values.options, "\t"),
+            possible_values.requirements.first,
+            possible_values.requirements.second,
+            possible_values.default_value_from_prefix,
+            possible_values.default_value);
+    }
+    checkpoint.options_hash = content_hash(options);
+}
+
+std::size_t
+application::resume_search(
+    std::size_t &total_neighbors_evaluated,
+    std::size_t &total_timeouts,
+    std::chrono::steady_clock::duration &total_evaluation_time) {
+    fmt::print(fmt::fg(fmt::terminal_color::blue), "## Resuming search\n");
+    std::optional<search_checkpoint> checkpoint = load_checkpoint(
+        checkpoint_path());
+    if (!checkpoint) {
+        fmt::print(
+            fmt::fg(fmt::terminal_color::yellow),
+            "No valid checkpoint {}: starting from the first parameter\n\n",
+            checkpoint_path().string());
+        return 0;
+    }
+    search_checkpoint current;
+    identify_search(current);
+    std::string_view changed;
+    if (checkpoint->formatter_hash != current.formatter_hash) {
+        changed = "clang-format, the metric, or the evaluation mode";
+    } else if (checkpoint->input != current.input) {
+        changed = "the input directory";
+    } else if (checkpoint->corpus_hash != current.corpus_hash) {
+        changed = "the input files";
+    } else if (checkpoint->options_hash != current.options_hash) {
+        changed = "the parameters or their values";
+    }
+    if (!changed.empty()) {
+        fmt::print(
+            fmt::fg(fmt::terminal_color::yellow),
+            "Checkpoint {} is outdated because {} changed: starting from "
+            "the first parameter\n\n",
+            checkpoint_path().string(),
+            changed);
+        return 0;
+    }
+    std::size_t next = cf_opts_.size();
+    if (!checkpoint->next_key.empty()) {
+        auto it = std::find_if(
+            cf_opts_.begin(),
+            cf_opts_.end(),
+            [&](auto const &p) { return p.first == checkpoint->next_key; });
+        if (it == cf_opts_.end()) {
+            fmt::print(
+                fmt::fg(fmt::terminal_color::yellow),
+                "Checkpoint parameter {} is unknown: starting from the first "
+                "parameter\n\n",
+                checkpoint->next_key);
+            return 0;
+        }
+        next = it - cf_opts_.begin();
+    }
+    current_cf_ = std::move(checkpoint->entries);
+    total_neighbors_evaluated = checkpoint->neighbors_evaluated;
+    total_timeouts = checkpoint->timeouts;
+    total_evaluation_time = checkpoint->evaluation_time;
+    closest_style_ = checkpoint->closest_style;
+    closest_distance_ = checkpoint->closest_distance;
+    if (next == cf_opts_.size()) {
+        fmt::print(
+            fmt::fg(fmt::terminal_color::green),
+            "All parameters were already evaluated\n\n");
+    } else {
+        fmt::print(
+            fmt::fg(fmt::terminal_color::green),
+            "Resuming from parameter {} ({} of {})\n\n",
+            checkpoint->next_key,
+            next + 1,
+            cf_opts_.size());
+    }
+    return next;
+}
+
 void
 application::clang_format_local_search() {
     std::chrono::steady_clock::duration total_evaluation_time(0);
@@ -383,16 +1353,29 @@ application::clang_format_local_search() {
         return x + p.second.options.size();
         });
     std::size_t total_neighbors_evaluated = 0;
+    std::size_t total_timeouts = 0;
+    std::size_t first_param = 0;
+    if (config_.resume) {
+        first_param = resume_search(
+            total_neighbors_evaluated,
+            total_timeouts,
+            total_evaluation_time);
+    }
     futures::asio::thread_pool pool(config_.parallel);
     auto ex = pool.executor();
+    spawn_ = [ex](std::function<void()> task) {
+        boost::asio::post(ex, std::move(task));
+    };
 
-    for (const auto &[key, possible_values]: cf_opts_) {
+    for (std::size_t param = first_param; param < cf_opts_.size(); ++param) {
+        const auto &[key, possible_values] = cf_opts_[param];
         bool req_applied = false;
         clang_format_entry prev_entry;
         apply_requirements(req_applied, prev_entry, possible_values);
         print_time_stats(
             total_evaluation_time,
             total_neighbors_evaluated,
+            total_timeouts,
             total_neighbors);
         fmt::print("Parameter ");
         fmt::print(fmt::fg(fmt::terminal_color::green), "{}\n", key);
@@ -402,6 +1385,7 @@ application::clang_format_local_search() {
             ex,
             closest_edit_distance,
             total_neighbors_evaluated,
+            total_timeouts,
             key,
             possible_values);
         // Undo requirements, unless the new score is already better anyway
@@ -419,7 +1403,32 @@ application::clang_format_local_search() {
         auto evaluation_end = std::chrono::steady_clock::now();
         auto evaluation_time = evaluation_end - evaluation_start;
         total_evaluation_time += evaluation_time;
+
+        // Save the state to continue from the next parameter
+        search_checkpoint checkpoint;
+        identify_search(checkpoint);
+        checkpoint.entries = current_cf_;
+        if (param + 1 < cf_opts_.size()) {
+            checkpoint.next_key = cf_opts_[param + 1].first;
+        }
+        checkpoint.neighbors_evaluated = total_neighbors_evaluated;
+        checkpoint.timeouts = total_timeouts;
+        checkpoint.evaluation_time = total_evaluation_time;
+        checkpoint.closest_style = closest_style_;
+        checkpoint.closest_distance = closest_distance_;
+        if (!save_checkpoint(checkpoint, checkpoint_path())) {
+            fmt::print(
+                fmt::fg(fmt::terminal_color::yellow),
+                "Cannot save checkpoint {}\n",
+                checkpoint_path().string());
+        }
     }
+
+    // Handlers of the last children might still be posting to the pool
+    if (reactor_) {
+        reactor_->drain();
+    }
+    spawn_ = nullptr;
 }
 
 void
@@ -443,6 +1452,10 @@ application::inherit_undetermined_values() {
                 find_if(cf_opts_.begin(), cf_opts_.end(), [&](auto &p) {
                     return p.first == entry.key;
                 });
+            if (opts_it == cf_opts_.end()) {
+                // Resumed entry this clang-format doesn't support
+                continue;
+            }
             auto &opts = opts_it->second;
             // Try to inherit from other similar prefixes
             constexpr auto starts_with =
@@ -523,6 +1536,10 @@ application::set_default_values() {
                 find_if(cf_opts_.begin(), cf_opts_.end(), [&](auto &p) {
                     return p.first == entry.key;
                 });
+            if (opts_it == cf_opts_.end()) {
+                // Resumed entry this clang-format doesn't support
+                continue;
+            }
             auto &opts = opts_it->second;
             if (!opts.default_value.empty()) {
                 entry.value = opts.default_value;
@@ -540,20 +1557,3 @@ application::set_default_values() {
     }
 }
 
-bool
-application::should_format(const fs::path &p) {
-    if (fs::is_regular_file(p) && p.has_extension()) {
-        auto file_ext_str = p.extension().string();
-        std::string_view file_ext_view = file_ext_str.c_str();
-        auto it = std::find_if(
-            config_.extensions.begin(),
-            config_.extensions.end(),
-            [file_ext_view](auto ext) {
-            return file_ext_view == ext
-                   || (file_ext_view.front() == '.'
-                       && file_ext_view.substr(1) == ext);
-            });
-        return it != config_.extensions.end();
-    }
-    return false;
-}
@@ -8,10 +8,27 @@
 #ifndef CLANG_UNFORMAT_APPLICATION_HPP
 #define CLANG_UNFORMAT_APPLICATION_HPP
 
+#include <checkpoint.hpp>
 #include <clang_format.hpp>
 #include <cli_config.hpp>
+#include <corpus.hpp>
+#include <disk_cache.hpp>
+#include <distance_memo.hpp>
+#include <format_cache.hpp>
+#include <incumbent.hpp>
+#include <levenshtein.hpp>
+#include <process_reactor.hpp>
+#include <replacements.hpp>
+#include <temp_slots.hpp>
 #include <boost/asio/thread_pool.hpp>
+#include <atomic>
 #include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_set>
 
 class application {
 public:
@@ -27,6 +44,34 @@ private:
     void
     clang_format_local_search();
 
+    // Remove the option values the clang-format version doesn't support
+    // before the search starts
+    void
+    probe_option_values();
+
+    // Check which styles clang-format accepts, considering the styles it
+    // could not check as accepted
+    std::vector<bool>
+    accepted_styles(std::vector<std::string> const &styles);
+
+    // File where the search state is saved after each parameter
+    std::filesystem::path
+    checkpoint_path() const;
+
+    // Set the fields that identify this search in a checkpoint: the
+    // formatter, the input files, and the parameters after probing
+    void
+    identify_search(search_checkpoint &checkpoint) const;
+
+    // Restore the state of an interrupted search from its checkpoint and
+    // return the index of the next parameter, or 0 if there's nothing to
+    // resume
+    std::size_t
+    resume_search(
+        std::size_t &total_neighbors_evaluated,
+        std::size_t &total_timeouts,
+        std::chrono::steady_clock::duration &total_evaluation_time);
+
     // Apply requirements to option
     void
     apply_requirements(
@@ -39,6 +84,7 @@ private:
     print_time_stats(
         std::chrono::steady_clock::duration total_evaluation_time,
         std::size_t total_neighbors_evaluated,
+        std::size_t total_timeouts,
         std::size_t total_neighbors) const;
 
     // Run tasks to evaluate a given option
@@ -47,6 +93,7 @@ private:
         const boost::asio::thread_pool::executor_type &ex,
         std::size_t &closest_edit_distance,
         std::size_t &total_neighbors_evaluated,
+        std::size_t &total_timeouts,
         std::string const &key,
         clang_format_possible_values const &possible_values);
 
@@ -58,28 +105,217 @@ private:
     void
     set_default_values();
 
-    // Check if we should format the path according to the config options
-    bool
-    should_format(const std::filesystem::path &p);
+    // Scan the input directory for the files to format
+    void
+    build_corpus();
+
+    struct temp_evaluation;
+    struct in_memory_evaluation;
+
+    // Maximum time clang-format might take to format a file
+    std::chrono::steady_clock::duration
+    file_timeout() const;
+
+    // Time limit for formatting all files of a candidate, which also allows
+    // cancelling them
+    std::shared_ptr<process_reactor::time_budget>
+    candidate_budget() const;
+
+    // Evaluate the edit distance of a candidate configuration, recording
+    // the outputs that differ from the incumbent outputs
+    std::future<std::size_t>
+    evaluate_candidate(
+        const boost::asio::thread_pool::executor_type &ex,
+        std::string style,
+        std::shared_ptr<candidate_outputs> outputs);
+
+    // Hash of the effective style of each candidate style, or nullopt if
+    // clang-format rejects the style
+    std::vector<std::optional<std::uint64_t>>
+    effective_style_hashes(std::vector<std::string> const &styles);
+
+    // Identify a file formatted with an effective style in the cache
+    format_cache::key
+    cache_key(std::uint64_t style, std::size_t file) const;
+
+    // Total distance of the files formatted with an effective style, if
+    // the cache or the cache directory have the distances of all files
+    std::optional<std::size_t>
+    cached_distance(std::uint64_t style);
+
+    // Store the distances of the files of a candidate in the cache and in
+    // the cache directory
+    void
+    cache_distances(std::uint64_t style, candidate_outputs const &outputs);
+
+    // Split the files in a temp directory into clang-format batches
+    std::vector<std::vector<std::string>>
+    temp_directory_batches(const std::filesystem::path &task_temp) const;
+
+    // Arguments to format a batch of files in place
+    static std::vector<std::string>
+    format_files_args(
+        const std::vector<std::string> &files,
+        std::string const &style);
 
-    // Format the given temp directory according to the config options
+    // Format a batch of files in place with a single clang-format process
     bool
-    format_temp_directory(const std::filesystem::path &task_temp);
+    format_files(
+        const std::vector<std::string> &files,
+        std::string const &style);
+
+    // Print which file in a batch clang-format cannot format
+    void
+    report_failed_batch(
+        const std::vector<std::string> &batch,
+        std::string const &style);
+
+    // Calculate the distance from a range of formatted files to the original
+    // files, given the distance accumulated by the previous files. Returns -1
+    // once the candidate is farther than the closest value.
+    std::size_t
+    distance_formatted_files(
+        temp_slots::lease &slot,
+        std::size_t first,
+        std::size_t last,
+        std::size_t accumulated,
+        candidate_outputs &outputs);
+
+    // Calculate the distance of a file unless it makes the candidate worse
+    // than the best candidate, given the distance accumulated so far. Only
+    // outputs that differ from the incumbent output are aligned, and they
+    // are recorded in the candidate outputs.
+    std::size_t
+    bounded_distance(
+        std::size_t file,
+        std::string_view formatted,
+        std::size_t accumulated,
+        candidate_outputs &outputs) const;
+
+    // Calculate the distance of the changes clang-format would make to a
+    // file unless it makes the candidate worse than the best candidate
+    std::size_t
+    bounded_replacements_distance(
+        std::size_t file,
+        std::vector<replacement> const &changes,
+        std::size_t accumulated,
+        candidate_outputs &outputs) const;
 
-    // Calculate the distance from the formatted files to the original files
+    // Calculate the distance between two texts of a file with the selected
+    // metric, or -1 if it exceeds the bound. If the original text is the
+    // whole file, the bit masks of the file are reused. Texts too large for
+    // the memory limit are counted in upper_bound_distances_.
     std::size_t
-    distance_formatted_files(const std::filesystem::path &task_temp);
+    metric_distance(
+        std::string_view original,
+        std::string_view formatted,
+        std::size_t bound,
+        std::size_t file) const;
+
+    // Get the bit masks of a file to compare it with its formatted outputs
+    std::shared_ptr<levenshtein_pattern const>
+    file_pattern(std::size_t file) const;
+
+    // Record the distance of a candidate whose evaluation is complete
+    void
+    record_distance(std::size_t distance);
+
+    // Evaluate the edit distance for all files in a temp slot
+    std::future<std::size_t>
+    evaluate(
+        const boost::asio::thread_pool::executor_type &ex,
+        std::string style,
+        std::shared_ptr<candidate_outputs> outputs);
+
+    // Format the next batch of files of a candidate in its temp slot
+    void
+    format_next_batch(
+        const boost::asio::thread_pool::executor_type &ex,
+        std::shared_ptr<temp_evaluation> const &e);
+
+    // Check if clang-format replaces the files it formats
+    bool
+    clang_format_replaces_files();
+
+    // Create the temp directories where the files are formatted
+    void
+    build_temp_slots();
+
+    // Evaluate the edit distance for all files by piping them through
+    // clang-format, which outputs the formatted files or the replacements
+    std::future<std::size_t>
+    evaluate_in_memory(
+        const boost::asio::thread_pool::executor_type &ex,
+        std::string const &style,
+        std::shared_ptr<candidate_outputs> outputs);
 
-    // Evaluate the edit distance for all files in specified directory
+#ifdef CLANG_UNFORMAT_HAS_LIBFORMAT
+    // Evaluate the edit distance for all files with clang's Format library
     std::size_t
-    evaluate(const std::filesystem::path &task_temp);
+    evaluate_libformat(
+        std::string const &inline_cf,
+        candidate_outputs &outputs);
+#endif
 
     // Cmd-line configuration values
     cli_config config_;
 
+    // The files to format
+    corpus corpus_;
+
+    // Distances of the formatted outputs scored so far
+    std::unique_ptr<distance_memo> memo_;
+
+    // Outputs of the closest candidate so far, whose distances are reused
+    std::unique_ptr<incumbent_outputs> incumbent_;
+
+    // Distances of the files formatted with each effective style
+    std::unique_ptr<format_cache> cache_;
+
+    // Distances kept between runs, if a cache directory is set
+    std::unique_ptr<disk_cache> disk_;
+
+    // Styles whose distances were already loaded from the cache directory
+    std::unordered_set<std::uint64_t> loaded_styles_;
+
+    // Effective style of the closest value of the last parameter and its
+    // distance, which the next parameter gets from its current value
+    std::optional<std::uint64_t> closest_style_;
+    std::size_t closest_distance_{ std::size_t(-1) };
+
+    // Hash of the full clang-format version, the metric and the evaluation
+    // mode, which identifies the cache entries of runs with the same
+    // distances
+    std::uint64_t formatter_hash_{ 0 };
+
+    // Bit masks of the files already compared, which are built lazily
+    mutable std::vector<std::shared_ptr<levenshtein_pattern const>> patterns_;
+    mutable std::size_t pattern_bytes_{ 0 };
+    mutable std::mutex patterns_mutex_;
+
+    // Number of distances that were only upper bounds so far
+    mutable std::atomic<std::size_t> upper_bound_distances_{ 0 };
+
+    // Files with distances that were only upper bounds, which are not kept
+    // in the cache directory
+    mutable std::vector<bool> upper_bound_files_;
+    mutable std::mutex upper_bound_mutex_;
+
+    // Runs tasks on the thread pool while the search runs
+    task_spawner spawn_;
+
+    // Launches the clang-format processes
+    std::unique_ptr<process_reactor> reactor_;
+
+    // Temp directories where copies of the files are formatted
+    std::unique_ptr<temp_slots> slots_;
+
     // The current list of clang-format entries
     std::vector<clang_format_entry> current_cf_;
 
+    // Best distance among the values of the current option evaluated so far
+    std::atomic<std::size_t> best_distance_{ std::size_t(-1) };
+
     // Clang format options and their valid values
     std::vector<std::pair<std::string, clang_format_possible_values>> cf_opts_{
         generate_clang_format_options()
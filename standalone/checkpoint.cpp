@@ -0,0 +1,206 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "checkpoint.hpp"
+#include <fmt/format.h>
+#include <charconv>
+#include <fstream>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // First line of a checkpoint file
+    constexpr std::string_view checkpoint_header = "clang-unformat "
+                                                   "checkpoint 2";
+
+    // Escape the characters that separate fields and lines
+    std::string
+    escape(std::string_view s) {
+        std::string r;
+        r.reserve(s.size());
+        for (char c: s) {
+            if (c == '\\') {
+                r += "\\\\";
+            } else if (c == '\t') {
+                r += "\\t";
+            } else if (c == '\n') {
+                r += "\\n";
+            } else {
+                r += c;
+            }
+        }
+        return r;
+    }
+
+    // Undo escape
+    std::string
+    unescape(std::string_view s) {
+        std::string r;
+        r.reserve(s.size());
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            if (s[i] != '\\' || i + 1 == s.size()) {
+                r += s[i];
+                continue;
+            }
+            char const c = s[++i];
+            r += c == 't' ? '\t' : c == 'n' ? '\n' : c;
+        }
+        return r;
+    }
+
+    // Split a line into its tab-separated fields
+    std::vector<std::string_view>
+    split_fields(std::string_view line) {
+        std::vector<std::string_view> fields;
+        std::size_t begin = 0;
+        for (;;) {
+            std::size_t const end = line.find('\t', begin);
+            fields.push_back(line.substr(begin, end - begin));
+            if (end == std::string_view::npos) {
+                return fields;
+            }
+            begin = end + 1;
+        }
+    }
+
+    // Parse an unsigned integer field
+    template <class T>
+    bool
+    parse_number(std::string_view s, T &value) {
+        auto res = std::from_chars(s.data(), s.data() + s.size(), value);
+        return res.ec == std::errc{} && res.ptr == s.data() + s.size();
+    }
+} // namespace
+
+bool
+save_checkpoint(const search_checkpoint &checkpoint, const fs::path &path) {
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream fout(tmp, std::ios::binary);
+        fout << checkpoint_header << '\n';
+        fout << "formatter\t" << checkpoint.formatter_hash << '\n';
+        fout << "input\t" << escape(checkpoint.input) << '\n';
+        fout << "corpus\t" << checkpoint.corpus_hash << '\n';
+        fout << "options\t" << checkpoint.options_hash << '\n';
+        fout << "next\t" << escape(checkpoint.next_key) << '\n';
+        fout << "evaluated\t" << checkpoint.neighbors_evaluated << '\n';
+        fout << "timeouts\t" << checkpoint.timeouts << '\n';
+        fout << "time\t"
+             << std::chrono::duration_cast<std::chrono::milliseconds>(
+                    checkpoint.evaluation_time)
+                    .count()
+             << '\n';
+        if (checkpoint.closest_style) {
+            fout << "closest\t" << *checkpoint.closest_style << '\t'
+                 << checkpoint.closest_distance << '\n';
+        }
+        for (const auto &[key, value, affected_output, score, failed, comment]:
+             checkpoint.entries)
+        {
+            fout << fmt::format(
+                "entry\t{}\t{}\t{:d}\t{}\t{:d}\t{}\n",
+                escape(key),
+                escape(value),
+                affected_output,
+                score,
+                failed,
+                escape(comment));
+        }
+        if (!fout) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    return !ec;
+}
+
+std::optional<search_checkpoint>
+load_checkpoint(const fs::path &path) {
+    std::ifstream fin(path, std::ios::binary);
+    std::string line;
+    if (!std::getline(fin, line) || line != checkpoint_header) {
+        return std::nullopt;
+    }
+    search_checkpoint c;
+    bool has_next = false;
+    bool has_formatter = false;
+    bool has_input = false;
+    bool has_corpus = false;
+    bool has_options = false;
+    while (std::getline(fin, line)) {
+        std::vector<std::string_view> const fields = split_fields(line);
+        std::string_view const kind = fields.front();
+        if (kind == "entry" && fields.size() == 7) {
+            clang_format_entry e;
+            e.key = unescape(fields[1]);
+            e.value = unescape(fields[2]);
+            e.affected_output = fields[3] == "1";
+            e.failed = fields[5] == "1";
+            e.comment = unescape(fields[6]);
+            if (!parse_number(fields[4], e.score)) {
+                return std::nullopt;
+            }
+            c.entries.push_back(std::move(e));
+        } else if (kind == "formatter" && fields.size() == 2) {
+            if (!parse_number(fields[1], c.formatter_hash)) {
+                return std::nullopt;
+            }
+            has_formatter = true;
+        } else if (kind == "input" && fields.size() == 2) {
+            c.input = unescape(fields[1]);
+            has_input = true;
+        } else if (kind == "corpus" && fields.size() == 2) {
+            if (!parse_number(fields[1], c.corpus_hash)) {
+                return std::nullopt;
+            }
+            has_corpus = true;
+        } else if (kind == "options" && fields.size() == 2) {
+            if (!parse_number(fields[1], c.options_hash)) {
+                return std::nullopt;
+            }
+            has_options = true;
+        } else if (kind == "closest" && fields.size() == 3) {
+            std::uint64_t style = 0;
+            if (!parse_number(fields[1], style)
+                || !parse_number(fields[2], c.closest_distance))
+            {
+                return std::nullopt;
+            }
+            c.closest_style = style;
+        } else if (kind == "next" && fields.size() == 2) {
+            c.next_key = unescape(fields[1]);
+            has_next = true;
+        } else if (kind == "evaluated" && fields.size() == 2) {
+            if (!parse_number(fields[1], c.neighbors_evaluated)) {
+                return std::nullopt;
+            }
+        } else if (kind == "timeouts" && fields.size() == 2) {
+            if (!parse_number(fields[1], c.timeouts)) {
+                return std::nullopt;
+            }
+        } else if (kind == "time" && fields.size() == 2) {
+            long long ms = 0;
+            if (!parse_number(fields[1], ms)) {
+                return std::nullopt;
+            }
+            c.evaluation_time = std::chrono::duration_cast<
+                std::chrono::steady_clock::duration>(
+                std::chrono::milliseconds(ms));
+        } else {
+            return std::nullopt;
+        }
+    }
+    if (!has_next || !has_formatter || !has_input || !has_corpus
+        || !has_options)
+    {
+        return std::nullopt;
+    }
+    return c;
+}
@@ -0,0 +1,84 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_CHECKPOINT_HPP
+#define CLANG_UNFORMAT_CHECKPOINT_HPP
+
+#include <clang_format.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+/// The state of a search after a parameter is evaluated
+/**
+ * The search saves a checkpoint after each parameter, so it can continue
+ * from the next parameter when it's interrupted.
+ *
+ * The checkpoint also identifies the search, so a search with another
+ * formatter, input, or list of parameters doesn't continue from it.
+ */
+struct search_checkpoint {
+    /// Hash of the clang-format version, the metric and the evaluation mode
+    std::uint64_t formatter_hash{ 0 };
+
+    /// Input directory of the search
+    std::string input;
+
+    /// Hash of the names and contents of the input files
+    std::uint64_t corpus_hash{ 0 };
+
+    /// Hash of the parameters and their possible values
+    std::uint64_t options_hash{ 0 };
+
+    /// The entries chosen so far, including their scores and comments
+    std::vector<clang_format_entry> entries;
+
+    /// Key of the next parameter to evaluate, or empty if all parameters
+    /// were evaluated
+    std::string next_key;
+
+    /// Number of parameter values evaluated so far
+    std::size_t neighbors_evaluated{ 0 };
+
+    /// Number of parameter values that timed out so far
+    std::size_t timeouts{ 0 };
+
+    /// Time spent evaluating parameter values so far
+    std::chrono::steady_clock::duration evaluation_time{ 0 };
+
+    /// Effective style of the closest value of the last parameter
+    std::optional<std::uint64_t> closest_style;
+
+    /// Distance of the closest value of the last parameter
+    std::size_t closest_distance{ std::size_t(-1) };
+};
+
+/// Save a checkpoint
+/**
+ * The checkpoint is written to a temporary file and renamed over the
+ * previous checkpoint, so an interrupted write never loses it.
+ *
+ * @return Whether the checkpoint was saved
+ */
+bool
+save_checkpoint(
+    const search_checkpoint &checkpoint,
+    const std::filesystem::path &path);
+
+/// Load a checkpoint
+/**
+ * @return The checkpoint or std::nullopt if the file does not exist or
+ * is not a valid checkpoint
+ */
+std::optional<search_checkpoint>
+load_checkpoint(const std::filesystem::path &path);
+
+#endif // CLANG_UNFORMAT_CHECKPOINT_HPP
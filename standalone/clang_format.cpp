@@ -17,12 +17,6 @@ generate_clang_format_options() {
         return str.substr(0, substr.size()) == substr;
     };
 
-    auto ends_with = [](std::string_view str, std::string_view substr) {
-        return str.size() > substr.size()
-               && str.substr(str.size() - substr.size(), substr.size())
-                      == substr;
-    };
-
     // list of all values
     std::vector<std::pair<std::string, clang_format_possible_values>> result{
   // Language, this format style is targeted at.
@@ -580,46 +574,65 @@ generate_clang_format_options() {
     }
 
     // set default_value
+    for (auto &[key, value]: result) {
+        value.default_value = reasonable_default_value(key, value.options);
+    }
+
+    return result;
+}
+
+std::string
+reasonable_default_value(
+    std::string_view key,
+    std::vector<std::string> const &options) {
+    auto starts_with = [](std::string_view str, std::string_view substr) {
+        return str.substr(0, substr.size()) == substr;
+    };
+
+    auto ends_with = [](std::string_view str, std::string_view substr) {
+        return str.size() > substr.size()
+               && str.substr(str.size() - substr.size(), substr.size())
+                      == substr;
+    };
+
     // We set the default values according to what is reasonable for each option
     // prefix
-    for (auto &[key, value]: result) {
-        // clang-format off
-        std::vector<std::pair<std::string, std::vector<std::string>>> prefix_defaults {
-            {"Align", {"true", "Always", "Right", "Yes", "Consecutive"}},
-            {"Allow", {"false", "Never", "None", "No"}},
-            {"AlwaysBreak", {"true", "Always", "All", "Yes"}},
-            {"BreakBefore", {"true", "Always", "All", "Yes"}},
-            {"Derive", {"true", "Always", "All", "Yes"}},
-            {"EmptyLine", {"true", "Always", "All", "Yes"}},
-            {"Indent", {"true", "Always", "All", "Yes"}},
-            {"PenaltyBreak", {"true", "Always", "All", "Yes"}},
-            {"SpaceAfter", {"true", "Always", "All", "Yes"}},
-            {"SpaceBefore", {"true", "Always", "All", "Yes"}},
-            {"SpaceIn", {"true", "Always", "All", "Yes"}},
-        };
-        // clang-format on
-        for (auto &[prefix, reasonable_defaults]: prefix_defaults) {
-            if (starts_with(key, prefix)) {
-                auto it = std::find_if(
-                    reasonable_defaults.begin(),
-                    reasonable_defaults.end(),
-                    [value = value, &ends_with](std::string const &def) {
-                    return std::find_if(
-                               value.options.begin(),
-                               value.options.end(),
-                               [&](const std::string &opt) {
-                        return ends_with(opt, def);
-                               })
-                        != value.options.end();
-                    });
-                if (it != reasonable_defaults.end()) {
-                    value.default_value = *it;
-                }
+    // clang-format off
+    std::vector<std::pair<std::string, std::vector<std::string>>> prefix_defaults {
+        {"Align", {"true", "Always", "Right", "Yes", "Consecutive"}},
+        {"Allow", {"false", "Never", "None", "No"}},
+        {"AlwaysBreak", {"true", "Always", "All", "Yes"}},
+        {"BreakBefore", {"true", "Always", "All", "Yes"}},
+        {"Derive", {"true", "Always", "All", "Yes"}},
+        {"EmptyLine", {"true", "Always", "All", "Yes"}},
+        {"Indent", {"true", "Always", "All", "Yes"}},
+        {"PenaltyBreak", {"true", "Always", "All", "Yes"}},
+        {"SpaceAfter", {"true", "Always", "All", "Yes"}},
+        {"SpaceBefore", {"true", "Always", "All", "Yes"}},
+        {"SpaceIn", {"true", "Always", "All", "Yes"}},
+    };
+    // clang-format on
+    std::string default_value;
+    for (auto &[prefix, reasonable_defaults]: prefix_defaults) {
+        if (starts_with(key, prefix)) {
+            auto it = std::find_if(
+                reasonable_defaults.begin(),
+                reasonable_defaults.end(),
+                [&options, &ends_with](std::string const &def) {
+                return std::find_if(
+                           options.begin(),
+                           options.end(),
+                           [&](const std::string &opt) {
+                    return ends_with(opt, def);
+                           })
+                    != options.end();
+                });
+            if (it != reasonable_defaults.end()) {
+                default_value = *it;
             }
         }
     }
-
-    return result;
+    return default_value;
 }
 
 void
@@ -696,6 +709,56 @@ print(const std::vector<clang_format_entry> &current_cf) {
     }
 }
 
+std::string
+inline_style(const std::vector<clang_format_entry> &current_cf) {
+    // Group subsections so each section is a single key in the mapping
+    std::vector<std::pair<std::string_view, std::string>> sections;
+    for (const auto &[key, value, affected_output, score, failed, comment]:
+         current_cf)
+    {
+        if (failed) {
+            continue;
+        }
+        std::string_view value_view = value;
+        if (auto last_under = value_view.find_last_of('_');
+            last_under != std::string_view::npos)
+        {
+            value_view = value_view.substr(last_under + 1);
+        }
+        auto subsection_begin = key.find_first_of('.');
+        if (bool section_only = subsection_begin == std::string::npos;
+            section_only)
+        {
+            sections.emplace_back(key, value_view);
+            continue;
+        }
+        auto section = std::string_view(key).substr(0, subsection_begin);
+        auto subsection = std::string_view(key).substr(subsection_begin + 1);
+        auto it = std::find_if(
+            sections.begin(),
+            sections.end(),
+            [section](auto const &s) { return s.first == section; });
+        if (it == sections.end()) {
+            sections.emplace_back(
+                section,
+                fmt::format("{{{}: {}}}", subsection, value_view));
+        } else {
+            it->second.insert(
+                it->second.size() - 1,
+                fmt::format(", {}: {}", subsection, value_view));
+        }
+    }
+    std::string style = "{";
+    for (const auto &[key, value]: sections) {
+        if (style.size() > 1) {
+            style += ", ";
+        }
+        style += fmt::format("{}: {}", key, value);
+    }
+    style += "}";
+    return style;
+}
+
 void
 save(
     const std::vector<clang_format_entry> &current_cf,
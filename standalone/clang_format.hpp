@@ -69,6 +69,15 @@ save(
     const std::vector<clang_format_entry> &current_cf,
     const std::filesystem::path &output);
 
+/// Serialize a list of clang format entries as an inline YAML style
+/**
+ * The style is a YAML flow mapping, such as "{BasedOnStyle: LLVM,
+ * BraceWrapping: {AfterClass: true}}", which can be passed to
+ * clang-format with the --style option. Failed entries are not included.
+ */
+std::string
+inline_style(const std::vector<clang_format_entry> &current_cf);
+
 /// Possible values for the specified clang format option
 struct clang_format_possible_values {
     /// Constructor
@@ -109,4 +118,14 @@ struct clang_format_possible_values {
 std::vector<std::pair<std::string, clang_format_possible_values>>
 generate_clang_format_options();
 
+/// Choose a reasonable default value for an option among its values
+/**
+ * The default depends on the prefix of the option key. If none of the
+ * reasonable values for the prefix is available, the default is empty.
+ */
+std::string
+reasonable_default_value(
+    std::string_view key,
+    std::vector<std::string> const &options);
+
 #endif // CLANG_UNFORMAT_CLANG_FORMAT_HPP
@@ -6,6 +6,10 @@
 //
 
 #include "cli_config.hpp"
+#include <process_launcher.hpp>
+#ifdef CLANG_UNFORMAT_HAS_LIBFORMAT
+#    include <libformat.hpp>
+#endif
 #include <boost/process.hpp>
 #include <boost/program_options.hpp>
 #include <fmt/color.h>
@@ -14,6 +18,7 @@
 #include <fmt/ranges.h>
 #include <algorithm>
 #include <charconv>
+#include <sstream>
 
 #if FMT_VERSION >= 90000
 template <>
@@ -47,7 +52,19 @@ program_description() {
         ("clang-format", po::value<fs::path>()->default_value(empty_path), "path to the clang-format executable")
         ("parallel", po::value<std::size_t>()->default_value(std::min(std::thread::hardware_concurrency(), static_cast<unsigned int>(1))), "number of threads")
         ("require-influence", po::value<bool>()->default_value(false), "only include parameters that influence the output")
-        ("extensions", po::value<std::vector<std::string>>(), "file extensions to format");
+        ("extensions", po::value<std::vector<std::string>>(), "file extensions to format")
+        ("evaluation", po::value<std::string>()->default_value("temp"), "how to evaluate candidates: \"temp\" formats a copy of the input in the temp directory, \"memory\" pipes files through clang-format, \"replacements\" only scores the changes clang-format would make, whose summed distances might exceed the distance of the whole file")
+        ("batch-files", po::value<std::size_t>()->default_value(64), "maximum number of files formatted by each clang-format process")
+        ("batch-bytes", po::value<std::size_t>()->default_value(1024 * 1024), "maximum number of bytes formatted by each clang-format process")
+        ("backend", po::value<std::string>()->default_value("process"), "how to format files: \"process\" runs the clang-format executable, \"libformat\" formats in-process with clang's Format library")
+        ("max-children", po::value<std::size_t>()->default_value((std::max)(std::thread::hardware_concurrency(), 1u)), "maximum number of clang-format processes running at the same time")
+        ("file-timeout", po::value<double>()->default_value(0), "seconds clang-format might take per file before it's killed (0 for no limit)")
+        ("candidate-timeout", po::value<double>()->default_value(0), "seconds clang-format might take to format all files with a parameter value (0 for no limit)")
+        ("metric", po::value<std::string>()->default_value("levenshtein"), "how to measure the distance to the original files: \"levenshtein\" counts edited characters, \"whitespace\" compares the whitespace between tokens in linear time when only whitespace changes")
+        ("align-memory", po::value<std::size_t>()->default_value(1024), "megabytes the threads might use to align files with their formatted outputs, beyond which large files are aligned in windows and their distances might be upper bounds (0 for no limit)")
+        ("cache", po::value<fs::path>()->default_value(empty_path), "directory where the distances of formatted files are kept between runs, which might be shared by many processes")
+        ("cache-size", po::value<std::size_t>()->default_value(256), "maximum megabytes of the cache directory")
+        ("resume", po::value<bool>()->default_value(false), "continue the search from the checkpoint saved next to the output file after each parameter, if the input files, parameters, and clang-format did not change");
     }
     // clang-format on
     return desc;
@@ -71,17 +88,56 @@ parse_cli(int argc, char **argv) {
     }
     c.parallel = vm["parallel"].as<std::size_t>();
     c.require_influence = vm["require-influence"].as<bool>();
+    auto const &evaluation = vm["evaluation"].as<std::string>();
+    if (evaluation == "temp") {
+        c.evaluation = evaluation_mode::temp_directory;
+    } else if (evaluation == "memory") {
+        c.evaluation = evaluation_mode::in_memory;
+    } else if (evaluation == "replacements") {
+        c.evaluation = evaluation_mode::replacements;
+    } else {
+        throw po::invalid_option_value(evaluation);
+    }
+    c.batch_files = vm["batch-files"].as<std::size_t>();
+    c.batch_bytes = vm["batch-bytes"].as<std::size_t>();
+    auto const &backend = vm["backend"].as<std::string>();
+    if (backend == "process") {
+        c.backend = formatter_backend::process;
+    } else if (backend == "libformat") {
+        c.backend = formatter_backend::libformat;
+    } else {
+        throw po::invalid_option_value(backend);
+    }
+    c.max_children = vm["max-children"].as<std::size_t>();
+    c.file_timeout = std::chrono::duration<double>(
+        vm["file-timeout"].as<double>());
+    c.candidate_timeout = std::chrono::duration<double>(
+        vm["candidate-timeout"].as<double>());
+    auto const &metric = vm["metric"].as<std::string>();
+    if (metric == "levenshtein") {
+        c.metric = distance_metric::levenshtein;
+    } else if (metric == "whitespace") {
+        c.metric = distance_metric::whitespace;
+    } else {
+        throw po::invalid_option_value(metric);
+    }
+    c.align_memory = vm["align-memory"].as<std::size_t>();
+    c.cache = vm["cache"].as<fs::path>();
+    c.cache_size = vm["cache-size"].as<std::size_t>();
+    c.resume = vm["resume"].as<bool>();
     return c;
 }
 
+// Temp directories only hold the files to be formatted, so their
+// layout should be a subset of the input layout
 bool
 equal_directory_layout(const fs::path &temp, const fs::path &input) {
-    auto begin = fs::recursive_directory_iterator(input);
+    auto begin = fs::recursive_directory_iterator(temp);
     auto end = fs::recursive_directory_iterator{};
     for (auto it = begin; it != end; ++it) {
-        fs::path input_relative = fs::relative(*it, input);
-        fs::path output_relative = temp / input_relative;
-        if (!fs::exists(output_relative)) {
+        fs::path temp_relative = fs::relative(*it, temp);
+        fs::path input_relative = input / temp_relative;
+        if (!fs::exists(input_relative)) {
             return false;
         }
     }
@@ -157,7 +213,10 @@ validate_output_dir(cli_config &config) {
                 config.output);
             return true;
         }
-        return false;
+        // A resumed search continues the output it saved before
+        if (!config.resume) {
+            return false;
+        }
     }
     if (config.output.filename() != ".clang-format") {
         fmt::print(
@@ -238,19 +297,20 @@ validate_temp_dir(cli_config &config) {
 }
 
 // store the clang format version for future error messages
-// we run clang-format --version with boost::process to extract the version
+// we run clang-format --version with a process_launcher to extract the version
 bool
 set_clang_format_version(cli_config &config) {
     fmt::print(
         fmt::fg(fmt::terminal_color::yellow),
         "default to {}\n",
         config.clang_format);
-    process::ipstream is;
-    process::child
-        c(config.clang_format.c_str(), "--version", process::std_out > is);
+    std::string output = process_launcher(config.clang_format)
+                             .run({ "--version" })
+                             .second;
+    std::istringstream is(output);
     std::string line;
 
-    while (c.running() && std::getline(is, line) && !line.empty()) {
+    while (std::getline(is, line) && !line.empty()) {
         fmt::print(fmt::fg(fmt::terminal_color::green), "{}\n", line);
         std::string_view line_view(line);
         // find line with version
@@ -284,6 +344,7 @@ set_clang_format_version(cli_config &config) {
         }
 
         config.clang_format_version = major;
+        config.clang_format_full_version = line;
         if (major < 13) {
             fmt::print(
                 fmt::fg(fmt::terminal_color::red),
@@ -295,11 +356,58 @@ set_clang_format_version(cli_config &config) {
     return true;
 }
 
+bool
+validate_backend(cli_config &config) {
+    fmt::print(fmt::fg(fmt::terminal_color::blue), "## Validating backend\n");
+    if (config.backend == formatter_backend::libformat) {
+#ifdef CLANG_UNFORMAT_HAS_LIBFORMAT
+        config.clang_format_version = libformat_version();
+        config.clang_format_full_version = libformat_full_version();
+        fmt::print(
+            fmt::fg(fmt::terminal_color::green),
+            "clang Format library version {}\n",
+            config.clang_format_version);
+        if (config.evaluation != evaluation_mode::in_memory) {
+            config.evaluation = evaluation_mode::in_memory;
+            fmt::print(
+                fmt::fg(fmt::terminal_color::yellow),
+                "libformat backend always evaluates candidates in memory\n");
+        }
+#else
+        fmt::print(
+            fmt::fg(fmt::terminal_color::red),
+            "clang-unformat was built without the clang Format library\n");
+        return false;
+#endif
+    }
+    fmt::print(
+        fmt::fg(fmt::terminal_color::green),
+        "config \"backend\" {} OK!\n",
+        config.backend == formatter_backend::libformat ? "libformat" :
+                                                         "process");
+    fmt::print("\n");
+    return true;
+}
+
 bool
 validate_clang_format_executable(cli_config &config) {
     fmt::print(
         fmt::fg(fmt::terminal_color::blue),
         "## Validating clang-format\n");
+    if (config.backend == formatter_backend::libformat) {
+        if (!config.clang_format.empty()) {
+            fmt::print(
+                fmt::fg(fmt::terminal_color::yellow),
+                "libformat formats with clang {} and ignores clang-format "
+                "{}\n",
+                config.clang_format_version,
+                config.clang_format.string());
+        } else {
+            fmt::print("clang-format executable not required by libformat\n");
+        }
+        fmt::print("\n");
+        return true;
+    }
     if (config.clang_format.empty()) {
         fmt::print("no clang-format path set\n");
         config.clang_format = process::search_path("clang-format").c_str();
@@ -371,6 +479,118 @@ validate_threads(cli_config &config) {
     return true;
 }
 
+bool
+validate_batches(cli_config &config) {
+    fmt::print(fmt::fg(fmt::terminal_color::blue), "## Validating batches\n");
+    if (config.batch_files == 0) {
+        fmt::print(
+            fmt::fg(fmt::terminal_color::yellow),
+            "Cannot format batches of {} files\n",
+            config.batch_files);
+        config.batch_files = 1;
+        fmt::print(
+            fmt::fg(fmt::terminal_color::yellow),
+            "Defaulting to {} file per batch\n",
+            config.batch_files);
+    }
+    fmt::print(
+        fmt::fg(fmt::terminal_color::green),
+        "config \"batch-files\" {} OK!\n",
+        config.batch_files);
+    fmt::print(
+        fmt::fg(fmt::terminal_color::green),
+        "config \"batch-bytes\" {} OK!\n",
+        config.batch_bytes);
+    fmt::print("\n");
+    return true;
+}
+
+bool
+validate_max_children(cli_config &config) {
+    fmt::print(
+        fmt::fg(fmt::terminal_color::blue),
+        "## Validating max children\n");
+    if (config.max_children == 0) {
+        fmt::print(
+            fmt::fg(fmt::terminal_color::yellow),
+            "Cannot run {} clang-format processes at the same time\n",
+            config.max_children);
+        config.max_children = 1;
+        fmt::print(
+            fmt::fg(fmt::terminal_color::yellow),
+            "Defaulting to {} process\n",
+            config.max_children);
+    }
+    fmt::print(
+        fmt::fg(fmt::terminal_color::green),
+        "config \"max-children\" {} OK!\n",
+        config.max_children);
+    fmt::print("\n");
+    return true;
+}
+
+bool
+validate_timeouts(cli_config &config) {
+    fmt::print(fmt::fg(fmt::terminal_color::blue), "## Validating timeouts\n");
+    for (auto *timeout: { &config.file_timeout, &config.candidate_timeout }) {
+        if (timeout->count() < 0) {
+            fmt::print(
+                fmt::fg(fmt::terminal_color::yellow),
+                "Cannot wait for {} seconds\n",
+                timeout->count());
+            *timeout = std::chrono::duration<double>::zero();
+            fmt::print(
+                fmt::fg(fmt::terminal_color::yellow),
+                "Defaulting to no limit\n");
+        }
+    }
+    if (config.backend == formatter_backend::libformat
+        && (config.file_timeout.count() > 0
+            || config.candidate_timeout.count() > 0))
+    {
+        fmt::print(
+            fmt::fg(fmt::terminal_color::yellow),
+            "Timeouts only apply to the \"process\" backend\n");
+    }
+    fmt::print(
+        fmt::fg(fmt::terminal_color::green),
+        "config \"file-timeout\" {} OK!\n",
+        config.file_timeout.count());
+    fmt::print(
+        fmt::fg(fmt::terminal_color::green),
+        "config \"candidate-timeout\" {} OK!\n",
+        config.candidate_timeout.count());
+    fmt::print("\n");
+    return true;
+}
+
+bool
+validate_cache_dir(cli_config &config) {
+    if (config.cache.empty()) {
+        return true;
+    }
+    fmt::print(fmt::fg(fmt::terminal_color::blue), "## Validating cache\n");
+    std::error_code ec;
+    fs::create_directories(config.cache, ec);
+    if (!fs::is_directory(config.cache)) {
+        fmt::print(
+            fmt::fg(fmt::terminal_color::red),
+            "cache {} is not a directory\n",
+            config.cache);
+        return false;
+    }
+    fmt::print(
+        fmt::fg(fmt::terminal_color::green),
+        "config \"cache\" {} OK!\n",
+        config.cache);
+    fmt::print(
+        fmt::fg(fmt::terminal_color::green),
+        "config \"cache-size\" {} OK!\n",
+        config.cache_size);
+    fmt::print("\n");
+    return true;
+}
+
 bool
 validate_config(cli_config &config) {
     namespace fs = std::filesystem;
@@ -380,9 +600,14 @@ validate_config(cli_config &config) {
     CHECK(validate_input_dir(config));
     CHECK(validate_output_dir(config));
     CHECK(validate_temp_dir(config));
+    CHECK(validate_backend(config));
     CHECK(validate_clang_format_executable(config));
     CHECK(validate_file_extensions(config));
     CHECK(validate_threads(config));
+    CHECK(validate_batches(config));
+    CHECK(validate_max_children(config));
+    CHECK(validate_timeouts(config));
+    CHECK(validate_cache_dir(config));
 #undef CHECK
     fmt::print("=============================\n\n");
     return true;
@@ -9,9 +9,41 @@
 #define CLANG_UNFORMAT_CLI_CONFIG_HPP
 
 #include <boost/program_options/options_description.hpp>
+#include <chrono>
 #include <filesystem>
 #include <thread>
 
+/// How candidate clang-format configurations are evaluated
+enum class evaluation_mode
+{
+    /// Copy the input directory to the temp directory and format it in place
+    temp_directory,
+    /// Pipe each source file through clang-format and keep the result in memory
+    in_memory,
+    /// Pipe each source file through clang-format and score the replacements
+    /// it would make
+    replacements
+};
+
+/// How clang-format is invoked to format the candidates
+enum class formatter_backend
+{
+    /// Run the clang-format executable
+    process,
+    /// Format in-process with clang's Format library
+    libformat
+};
+
+/// How the distance between the original and formatted files is measured
+enum class distance_metric
+{
+    /// Count the characters inserted, removed or replaced
+    levenshtein,
+    /// Compare the whitespace between tokens, or fall back to levenshtein
+    /// when the tokens differ
+    whitespace
+};
+
 /// The command line options
 struct cli_config {
     bool help{ false };
@@ -20,9 +52,22 @@ struct cli_config {
     std::filesystem::path temp;
     std::filesystem::path clang_format;
     std::size_t clang_format_version{ 0 };
+    std::string clang_format_full_version;
     std::vector<std::string> extensions;
     std::size_t parallel{ std::thread::hardware_concurrency() };
     bool require_influence{ false };
+    evaluation_mode evaluation{ evaluation_mode::temp_directory };
+    std::size_t batch_files{ 64 };
+    std::size_t batch_bytes{ 1024 * 1024 };
+    formatter_backend backend{ formatter_backend::process };
+    std::size_t max_children{ std::thread::hardware_concurrency() };
+    std::chrono::duration<double> file_timeout{ 0 };
+    std::chrono::duration<double> candidate_timeout{ 0 };
+    distance_metric metric{ distance_metric::levenshtein };
+    std::size_t align_memory{ 1024 };
+    std::filesystem::path cache;
+    std::size_t cache_size{ 256 };
+    bool resume{ false };
 };
 
 /// Print the config options
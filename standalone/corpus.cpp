@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "corpus.hpp"
+#include <algorithm>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+corpus::corpus(
+    const fs::path &input,
+    const std::vector<std::string> &extensions)
+    : input_(input) {
+    // Find the files and their sizes
+    std::uintmax_t arena_size = 0;
+    auto begin = fs::recursive_directory_iterator(input);
+    auto end = fs::recursive_directory_iterator{};
+    for (auto it = begin; it != end; ++it) {
+        if (!it->is_regular_file() || !has_extension(it->path(), extensions))
+        {
+            continue;
+        }
+        corpus_file f;
+        f.relative = fs::relative(it->path(), input);
+        f.size = it->file_size();
+        arena_size += f.size;
+        files_.push_back(std::move(f));
+    }
+    std::sort(
+        files_.begin(),
+        files_.end(),
+        [](corpus_file const &a, corpus_file const &b) {
+        return a.relative < b.relative;
+        });
+
+    // Load the contents into the arena
+    arena_ = std::make_unique<char[]>(arena_size);
+    char *pos = arena_.get();
+    for (corpus_file &f: files_) {
+        std::ifstream fin(input / f.relative, std::ios::binary);
+        fin.read(pos, static_cast<std::streamsize>(f.size));
+        f.size = static_cast<std::uintmax_t>(fin.gcount());
+        f.content = std::string_view(pos, f.size);
+        f.hash = content_hash(f.content);
+        pos += f.size;
+        total_size_ += f.size;
+    }
+}
+
+bool
+has_extension(const fs::path &p, const std::vector<std::string> &extensions) {
+    if (!p.has_extension()) {
+        return false;
+    }
+    auto file_ext_str = p.extension().string();
+    std::string_view file_ext_view = file_ext_str;
+    return std::any_of(
+        extensions.begin(),
+        extensions.end(),
+        [file_ext_view](std::string_view ext) {
+        return file_ext_view == ext
+               || (file_ext_view.front() == '.'
+                   && file_ext_view.substr(1) == ext);
+        });
+}
+
+std::uint64_t
+content_hash(std::string_view content) {
+    // 64-bit FNV-1a
+    std::uint64_t h = 14695981039346656037ull;
+    for (char c: content) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
@@ -0,0 +1,90 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_CORPUS_HPP
+#define CLANG_UNFORMAT_CORPUS_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// A source file eligible for formatting
+struct corpus_file {
+    /// Path relative to the input directory
+    std::filesystem::path relative;
+
+    /// File size in bytes
+    std::uintmax_t size{ 0 };
+
+    /// Hash of the file contents
+    std::uint64_t hash{ 0 };
+
+    /// File contents, owned by the corpus
+    std::string_view content;
+};
+
+/// Immutable manifest of the source files eligible for formatting
+/**
+ * The input directory is scanned only once, when the corpus is created.
+ * All later stages iterate the manifest instead of the directory tree.
+ *
+ * The contents of all files are loaded into a single read-only arena, so
+ * evaluations can share the original bytes without reading the files again.
+ * Moving the corpus does not invalidate the file contents.
+ */
+class corpus {
+public:
+    /// Constructor
+    corpus() = default;
+
+    /// Scan the input directory for files with the specified extensions
+    corpus(
+        const std::filesystem::path &input,
+        const std::vector<std::string> &extensions);
+
+    /// The input directory
+    const std::filesystem::path &
+    input() const {
+        return input_;
+    }
+
+    /// The eligible files, sorted by relative path
+    const std::vector<corpus_file> &
+    files() const {
+        return files_;
+    }
+
+    /// Total size of the eligible files in bytes
+    std::uintmax_t
+    total_size() const {
+        return total_size_;
+    }
+
+private:
+    std::filesystem::path input_;
+    std::vector<corpus_file> files_;
+    std::unique_ptr<char[]> arena_;
+    std::uintmax_t total_size_{ 0 };
+};
+
+/// Check if the path has one of the specified extensions
+/**
+ * Extensions might be specified with or without the leading '.'.
+ */
+bool
+has_extension(
+    const std::filesystem::path &p,
+    const std::vector<std::string> &extensions);
+
+/// Hash the contents of a file or string
+std::uint64_t
+content_hash(std::string_view content);
+
+#endif // CLANG_UNFORMAT_CORPUS_HPP
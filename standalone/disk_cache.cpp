@@ -0,0 +1,153 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "disk_cache.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Size of each entry in a file
+    constexpr std::size_t entry_bytes = 2 * sizeof(std::uint64_t);
+
+    // Check if a file name is a hash written by the cache
+    bool
+    is_hash_name(fs::path const &p) {
+        std::string const name = p.filename().string();
+        return name.size() == 16
+               && std::all_of(name.begin(), name.end(), [](char c) {
+                      return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+                  });
+    }
+} // namespace
+
+disk_cache::disk_cache(fs::path dir, std::size_t max_bytes)
+    : dir_(std::move(dir)), max_bytes_(max_bytes) {
+    trim();
+}
+
+fs::path
+disk_cache::style_path(std::uint64_t style, std::uint64_t version) const {
+    return dir_ / fmt::format("{:016x}", version)
+           / fmt::format("{:016x}", style);
+}
+
+std::vector<disk_cache::entry>
+disk_cache::load(std::uint64_t style, std::uint64_t version) const {
+    std::vector<entry> entries;
+    std::ifstream fin(style_path(style, version), std::ios::binary);
+    std::uint64_t record[2];
+    while (fin.read(reinterpret_cast<char *>(record), entry_bytes)) {
+        entries.emplace_back(record[0], static_cast<std::size_t>(record[1]));
+    }
+    return entries;
+}
+
+void
+disk_cache::store(
+    std::uint64_t style,
+    std::uint64_t version,
+    std::vector<entry> const &entries) {
+    // Merge with the distances other runs stored for the same style
+    std::unordered_map<std::uint64_t, std::size_t> merged;
+    std::vector<entry> const stored = load(style, version);
+    for (entry const &e: stored) {
+        merged.insert(e);
+    }
+    for (entry const &e: entries) {
+        merged[e.first] = e.second;
+    }
+
+    // Readers only ever see the previous or the new complete file
+    fs::path const path = style_path(style, version);
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    std::random_device rd;
+    fs::path const tmp = path.parent_path()
+                         / fmt::format("{:08x}{:08x}.tmp", rd(), rd());
+    {
+        std::ofstream fout(tmp, std::ios::binary);
+        for (auto const &[file, distance]: merged) {
+            std::uint64_t const record[2] = { file, distance };
+            fout.write(reinterpret_cast<char const *>(record), entry_bytes);
+        }
+        if (!fout) {
+            fout.close();
+            fs::remove(tmp, ec);
+            return;
+        }
+    }
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return;
+    }
+    if (merged.size() > stored.size()) {
+        bytes_ += (merged.size() - stored.size()) * entry_bytes;
+    }
+    if (bytes_ > max_bytes_) {
+        trim();
+    }
+}
+
+void
+disk_cache::trim() {
+    struct stored_file {
+        fs::path path;
+        std::uintmax_t size;
+        fs::file_time_type time;
+    };
+    std::vector<stored_file> files;
+    std::uintmax_t total = 0;
+    std::error_code ec;
+    // Only the version directories and style files of the cache are
+    // considered, so other files in the directory are never removed
+    for (auto dir_it = fs::directory_iterator(dir_, ec);
+         !ec && dir_it != fs::directory_iterator();
+         dir_it.increment(ec))
+    {
+        std::error_code dir_ec;
+        if (!is_hash_name(dir_it->path()) || !dir_it->is_directory(dir_ec)) {
+            continue;
+        }
+        for (auto it = fs::directory_iterator(dir_it->path(), dir_ec);
+             !dir_ec && it != fs::directory_iterator();
+             it.increment(dir_ec))
+        {
+            std::error_code file_ec;
+            if (!is_hash_name(it->path()) || !it->is_regular_file(file_ec)) {
+                continue;
+            }
+            std::uintmax_t const size = it->file_size(file_ec);
+            fs::file_time_type const time = it->last_write_time(file_ec);
+            if (!file_ec) {
+                files.push_back(stored_file{ it->path(), size, time });
+                total += size;
+            }
+        }
+    }
+
+    // Files removed by other processes in the meantime are not an error
+    std::sort(
+        files.begin(),
+        files.end(),
+        [](stored_file const &a, stored_file const &b) {
+        return a.time < b.time;
+        });
+    for (stored_file const &f: files) {
+        if (total <= max_bytes_) {
+            break;
+        }
+        fs::remove(f.path, ec);
+        total -= f.size;
+    }
+    bytes_ = total;
+}
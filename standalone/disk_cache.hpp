@@ -0,0 +1,66 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_DISK_CACHE_HPP
+#define CLANG_UNFORMAT_DISK_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <utility>
+#include <vector>
+
+/// Distances of formatted files kept in a directory between runs
+/**
+ * The directory has a subdirectory for each version, which identifies the
+ * clang-format version and how distances are measured, and a file for
+ * each effective style, with the hash of each file name and contents
+ * followed by its distance.
+ *
+ * Many processes might share the directory. Files are written to a
+ * temporary file and renamed over the previous version, so readers always
+ * see complete files. When two processes store the same style at the same
+ * time, the entries of one of them might be lost.
+ *
+ * The least recently stored style files are removed once they exceed the
+ * size limit. Other files in the directory are left alone.
+ */
+class disk_cache {
+public:
+    /// A file hash and its distance
+    using entry = std::pair<std::uint64_t, std::size_t>;
+
+    /// Constructor
+    disk_cache(std::filesystem::path dir, std::size_t max_bytes);
+
+    /// Load the distances stored for an effective style
+    std::vector<entry>
+    load(std::uint64_t style, std::uint64_t version) const;
+
+    /// Store distances for an effective style, keeping the stored ones
+    void
+    store(
+        std::uint64_t style,
+        std::uint64_t version,
+        std::vector<entry> const &entries);
+
+private:
+    // File with the distances of a style
+    std::filesystem::path
+    style_path(std::uint64_t style, std::uint64_t version) const;
+
+    // Remove the oldest style files until they fit in the size limit
+    void
+    trim();
+
+    std::filesystem::path dir_;
+    std::size_t max_bytes_;
+    // Estimated size of the style files
+    std::uintmax_t bytes_{ 0 };
+};
+
+#endif // CLANG_UNFORMAT_DISK_CACHE_HPP
@@ -0,0 +1,42 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "distance_memo.hpp"
+#include <corpus.hpp>
+
+distance_memo::distance_memo(std::size_t files, std::size_t max_bytes)
+    : files_(files), max_bytes_(max_bytes) {}
+
+std::optional<std::size_t>
+distance_memo::find(std::size_t file, std::string_view output) const {
+    std::uint64_t const h = content_hash(output);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const &outputs = files_[file];
+    auto it = outputs.find(h);
+    if (it == outputs.end() || it->second.output != output) {
+        return std::nullopt;
+    }
+    return it->second.distance;
+}
+
+void
+distance_memo::insert(
+    std::size_t file,
+    std::string_view output,
+    std::size_t distance) {
+    std::uint64_t const h = content_hash(output);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (bytes_ + output.size() > max_bytes_) {
+        return;
+    }
+    auto [it, inserted] = files_[file].try_emplace(
+        h,
+        entry{ std::string(output), distance });
+    if (inserted) {
+        bytes_ += output.size();
+    }
+}
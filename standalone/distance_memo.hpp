@@ -0,0 +1,57 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_DISTANCE_MEMO_HPP
+#define CLANG_UNFORMAT_DISTANCE_MEMO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// Distances of the formatted outputs already scored for each file
+/**
+ * Different option values often produce the same output for a file. The
+ * memo keeps the outputs it has seen, indexed by their hash, so an output
+ * identical to a previous one reuses its distance instead of aligning the
+ * file again.
+ *
+ * Outputs are compared byte by byte, so hash collisions are harmless. New
+ * outputs are not stored once the memo reaches its size limit.
+ *
+ * The memo might be accessed from any thread.
+ */
+class distance_memo {
+public:
+    /// Constructor
+    distance_memo(std::size_t files, std::size_t max_bytes);
+
+    /// Find the distance of an output of a file scored before
+    std::optional<std::size_t>
+    find(std::size_t file, std::string_view output) const;
+
+    /// Store the distance of an output of a file
+    void
+    insert(std::size_t file, std::string_view output, std::size_t distance);
+
+private:
+    struct entry {
+        std::string output;
+        std::size_t distance;
+    };
+
+    std::vector<std::unordered_map<std::uint64_t, entry>> files_;
+    std::size_t max_bytes_;
+    std::size_t bytes_{ 0 };
+    mutable std::mutex mutex_;
+};
+
+#endif // CLANG_UNFORMAT_DISTANCE_MEMO_HPP
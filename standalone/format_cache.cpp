@@ -0,0 +1,41 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "format_cache.hpp"
+
+format_cache::format_cache(std::size_t max_bytes) : max_bytes_(max_bytes) {}
+
+std::optional<std::size_t>
+format_cache::find(key const &k) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(k);
+    if (it == index_.end()) {
+        return std::nullopt;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->distance;
+}
+
+void
+format_cache::insert(key const &k, std::size_t distance) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(k);
+    if (it != index_.end()) {
+        it->second->distance = distance;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return;
+    }
+    if (max_bytes_ < entry_bytes) {
+        return;
+    }
+    while ((entries_.size() + 1) * entry_bytes > max_bytes_) {
+        index_.erase(entries_.back().k);
+        entries_.pop_back();
+    }
+    entries_.push_front(entry{ k, distance });
+    index_.emplace(k, entries_.begin());
+}
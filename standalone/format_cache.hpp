@@ -0,0 +1,84 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_FORMAT_CACHE_HPP
+#define CLANG_UNFORMAT_FORMAT_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+/// Distances of the files formatted with each effective style
+/**
+ * Many candidate configurations have the same effective style, such as a
+ * value that BasedOnStyle already implies. The cache keeps the distance of
+ * each file formatted with each effective style, so a candidate whose
+ * distances are all known doesn't need to format the files again.
+ *
+ * Entries are identified by hashes only. The least recently used entries
+ * are evicted once the cache reaches its size limit.
+ *
+ * The cache might be accessed from any thread.
+ */
+class format_cache {
+public:
+    /// The identity of a formatted file
+    struct key {
+        /// Hash of the effective style
+        std::uint64_t style{ 0 };
+        /// Hash of the file name and contents
+        std::uint64_t file{ 0 };
+        /// Hash of the full version of clang-format
+        std::uint64_t version{ 0 };
+
+        bool
+        operator==(key const &other) const {
+            return style == other.style && file == other.file
+                   && version == other.version;
+        }
+    };
+
+    /// Constructor
+    explicit format_cache(std::size_t max_bytes);
+
+    /// Find the distance of a formatted file
+    std::optional<std::size_t>
+    find(key const &k);
+
+    /// Store the distance of a formatted file
+    void
+    insert(key const &k, std::size_t distance);
+
+private:
+    struct key_hash {
+        std::size_t
+        operator()(key const &k) const {
+            return static_cast<std::size_t>(
+                k.style ^ (k.file * 31) ^ (k.version * 1099511628211ull));
+        }
+    };
+
+    struct entry {
+        key k;
+        std::size_t distance;
+    };
+
+    // Memory used by each entry, including the list and map nodes
+    static constexpr std::size_t entry_bytes = sizeof(entry)
+                                               + 6 * sizeof(void *);
+
+    // Entries from the most to the least recently used
+    std::list<entry> entries_;
+    std::unordered_map<key, std::list<entry>::iterator, key_hash> index_;
+    std::size_t max_bytes_;
+    mutable std::mutex mutex_;
+};
+
+#endif // CLANG_UNFORMAT_FORMAT_CACHE_HPP
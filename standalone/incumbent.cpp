@@ -0,0 +1,76 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "incumbent.hpp"
+
+candidate_outputs::candidate_outputs(
+    std::size_t files,
+    std::size_t max_bytes)
+    : distances_(files, std::size_t(-1)), max_bytes_(max_bytes) {}
+
+void
+candidate_outputs::record(
+    std::size_t file,
+    std::optional<std::string_view> output,
+    std::size_t distance) {
+    std::size_t const size = output ? output->size() : 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    distances_[file] = distance;
+    if (overflow_ || bytes_ + size > max_bytes_) {
+        // Free the outputs that can no longer be adopted
+        overflow_ = true;
+        changes_.clear();
+        return;
+    }
+    bytes_ += size;
+    std::optional<std::string> stored;
+    if (output) {
+        stored.emplace(*output);
+    }
+    changes_.push_back(change{ file, std::move(stored), distance });
+}
+
+void
+candidate_outputs::record_distance(std::size_t file, std::size_t distance) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    distances_[file] = distance;
+}
+
+std::vector<std::size_t>
+candidate_outputs::distances() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return distances_;
+}
+
+incumbent_outputs::incumbent_outputs(std::size_t files)
+    : outputs_(files), distances_(files, 0) {}
+
+std::optional<std::size_t>
+incumbent_outputs::find(std::size_t file, std::string_view output) const {
+    if (!outputs_[file] || *outputs_[file] != output) {
+        return std::nullopt;
+    }
+    return distances_[file];
+}
+
+bool
+incumbent_outputs::is_original(std::size_t file) const {
+    return !outputs_[file];
+}
+
+void
+incumbent_outputs::adopt(candidate_outputs &&candidate) {
+    std::lock_guard<std::mutex> lock(candidate.mutex_);
+    if (candidate.overflow_) {
+        return;
+    }
+    for (candidate_outputs::change &c: candidate.changes_) {
+        outputs_[c.file] = std::move(c.output);
+        distances_[c.file] = c.distance;
+    }
+    candidate.changes_.clear();
+}
@@ -0,0 +1,102 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_INCUMBENT_HPP
+#define CLANG_UNFORMAT_INCUMBENT_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// The outputs of a candidate that differ from the incumbent outputs
+/**
+ * Outputs are recorded with their distances while the candidate is
+ * evaluated, from any thread. Once the outputs reach the size limit, the
+ * candidate can no longer replace the incumbent outputs, but the distances
+ * of its files are still recorded.
+ */
+class candidate_outputs {
+public:
+    /// Constructor
+    candidate_outputs(std::size_t files, std::size_t max_bytes);
+
+    /// Record the output of a file, or nullopt if it's the original file
+    void
+    record(
+        std::size_t file,
+        std::optional<std::string_view> output,
+        std::size_t distance);
+
+    /// Record the distance of a file whose output is not recorded
+    void
+    record_distance(std::size_t file, std::size_t distance);
+
+    /// Distance of each file, or std::size_t(-1) if it was not scored
+    std::vector<std::size_t>
+    distances() const;
+
+private:
+    friend class incumbent_outputs;
+
+    struct change {
+        std::size_t file;
+        std::optional<std::string> output;
+        std::size_t distance;
+    };
+
+    std::vector<change> changes_;
+    std::vector<std::size_t> distances_;
+    std::size_t max_bytes_;
+    std::size_t bytes_{ 0 };
+    bool overflow_{ false };
+    mutable std::mutex mutex_;
+};
+
+/// The formatted outputs of the closest candidate so far
+/**
+ * Most parameter values only change the output of a few files relative
+ * to the closest candidate. An output equal to the incumbent output of its
+ * file reuses the incumbent distance, so only the files a value changes
+ * are aligned again.
+ *
+ * The incumbent starts with the original files, whose distances are zero.
+ * Reading from many threads is safe as long as no candidate is adopted
+ * at the same time.
+ */
+class incumbent_outputs {
+public:
+    /// Constructor
+    explicit incumbent_outputs(std::size_t files);
+
+    /// Distance of the incumbent output of a file, if it's equal to output
+    std::optional<std::size_t>
+    find(std::size_t file, std::string_view output) const;
+
+    /// Check if the incumbent output of a file is the original file
+    bool
+    is_original(std::size_t file) const;
+
+    /// Replace the incumbent outputs with the outputs a candidate changed
+    /**
+     * A candidate whose outputs reached the size limit leaves the incumbent
+     * unchanged. The incumbent outputs then belong to an older candidate,
+     * and their distances are still valid for the outputs that equal them.
+     */
+    void
+    adopt(candidate_outputs &&candidate);
+
+private:
+    // Output of each file, or nullopt if it's the original file
+    std::vector<std::optional<std::string>> outputs_;
+    std::vector<std::size_t> distances_;
+};
+
+#endif // CLANG_UNFORMAT_INCUMBENT_HPP
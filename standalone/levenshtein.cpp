@@ -6,34 +6,650 @@
 //
 
 #include "levenshtein.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
 #include <edlib.h>
-#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    // Strings smaller than this are aligned as a whole
+    constexpr std::size_t line_diff_min_size = 64 * 1024;
+
+    // Strings smaller than this are aligned by a single task
+    constexpr std::size_t parallel_min_size = 1024 * 1024;
+
+    // Align two strings with edlib
+    /*
+     * The alignment gives up once the distance exceeds the bound, in which
+     * case the result is std::size_t(-1).
+     */
+    std::size_t
+    align(std::string_view s1, std::string_view s2, std::size_t bound) {
+        // The length difference is a lower bound for the distance
+        std::size_t const length_diff = s1.size() > s2.size()
+                                            ? s1.size() - s2.size()
+                                            : s2.size() - s1.size();
+        if (length_diff > bound) {
+            return std::size_t(-1);
+        }
+        if (s1 == s2) {
+            return 0;
+        }
+        EdlibAlignConfig config = edlibDefaultAlignConfig();
+        if (bound < static_cast<std::size_t>(std::numeric_limits<int>::max()))
+        {
+            config.k = static_cast<int>(bound);
+        }
+        auto r = edlibAlign(
+            s1.data(),
+            static_cast<int>(s1.size()),
+            s2.data(),
+            static_cast<int>(s2.size()),
+            config);
+        std::size_t d = r.editDistance == -1 ? std::size_t(-1)
+                                             : r.editDistance;
+        edlibFreeAlignResult(r);
+        return d;
+    }
+
+    // Memory edlib needs to align two strings
+    /*
+     * edlib keeps the bit masks of each symbol and the state of each block
+     * of 64 characters of the first string, besides copies of both strings.
+     */
+    std::size_t
+    align_bytes(std::string_view s1, std::string_view s2) {
+        constexpr std::size_t block_bytes = (256 + 4) * sizeof(std::uint64_t);
+        return (s1.size() + 63) / 64 * block_bytes + s1.size() + s2.size();
+    }
+
+    // Find where a window starting at begin ends, preferring a line break
+    std::size_t
+    window_end(std::string_view s, std::size_t begin, std::size_t size) {
+        if (size >= s.size() - begin) {
+            return s.size();
+        }
+        std::size_t const line_end = s.rfind('\n', begin + size - 1);
+        if (line_end == std::string_view::npos || line_end < begin) {
+            return begin + size;
+        }
+        return line_end + 1;
+    }
+
+    // Align two strings in windows that fit in the memory limit
+    /*
+     * Each window of s1 is aligned with the window at the same relative
+     * position in s2. Joining the alignments of the windows gives an
+     * alignment of the strings, so the sum of their distances is an upper
+     * bound for the distance.
+     */
+    std::size_t
+    windowed_align(
+        std::string_view s1,
+        std::string_view s2,
+        std::size_t bound,
+        std::size_t max_bytes) {
+        std::size_t const bytes = align_bytes(s1, s2);
+        if (bytes <= max_bytes) {
+            return align(s1, s2, bound);
+        }
+        std::size_t const windows = (bytes + max_bytes - 1) / max_bytes;
+        std::size_t const window_size = (s1.size() + windows - 1) / windows;
+        std::size_t total = 0;
+        std::size_t begin1 = 0;
+        std::size_t begin2 = 0;
+        while (begin1 < s1.size() || begin2 < s2.size()) {
+            std::size_t const end1 = window_end(s1, begin1, window_size);
+            std::size_t end2 = s2.size();
+            if (end1 != s1.size()) {
+                std::size_t const target = end1 * s2.size() / s1.size();
+                end2 = target > begin2
+                           ? window_end(s2, begin2, target - begin2)
+                           : begin2;
+            }
+            std::size_t const d = align(
+                s1.substr(begin1, end1 - begin1),
+                s2.substr(begin2, end2 - begin2),
+                bound == std::size_t(-1) ? bound : bound - total);
+            if (d == std::size_t(-1)) {
+                return d;
+            }
+            total += d;
+            begin1 = end1;
+            begin2 = end2;
+        }
+        return total;
+    }
+
+    // Split a string into lines, keeping their line breaks
+    std::vector<std::string_view>
+    split_lines(std::string_view s) {
+        std::vector<std::string_view> lines;
+        std::size_t begin = 0;
+        while (begin < s.size()) {
+            std::size_t end = s.find('\n', begin);
+            end = end == std::string_view::npos ? s.size() : end + 1;
+            lines.push_back(s.substr(begin, end - begin));
+            begin = end;
+        }
+        return lines;
+    }
+
+    // Find lines that appear exactly once in each string and keep the
+    // longest sequence of them in the same order in both strings
+    std::vector<std::pair<std::size_t, std::size_t>>
+    unique_line_anchors(
+        std::vector<std::string_view> const &a,
+        std::vector<std::string_view> const &b) {
+        struct occurrences {
+            std::size_t count_a{ 0 };
+            std::size_t count_b{ 0 };
+            std::size_t index_a{ 0 };
+            std::size_t index_b{ 0 };
+        };
+        std::unordered_map<std::string_view, occurrences> lines;
+        lines.reserve(a.size());
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            occurrences &o = lines[a[i]];
+            ++o.count_a;
+            o.index_a = i;
+        }
+        for (std::size_t j = 0; j < b.size(); ++j) {
+            auto it = lines.find(b[j]);
+            if (it != lines.end()) {
+                ++it->second.count_b;
+                it->second.index_b = j;
+            }
+        }
+        std::vector<std::pair<std::size_t, std::size_t>> unique;
+        for (auto const &[line, o]: lines) {
+            if (o.count_a == 1 && o.count_b == 1) {
+                unique.emplace_back(o.index_a, o.index_b);
+            }
+        }
+        std::sort(unique.begin(), unique.end());
+
+        // Longest increasing subsequence of the positions in b
+        std::vector<std::size_t> tails;
+        std::vector<std::size_t> prev(unique.size(), std::size_t(-1));
+        for (std::size_t i = 0; i < unique.size(); ++i) {
+            auto it = std::lower_bound(
+                tails.begin(),
+                tails.end(),
+                unique[i].second,
+                [&unique](std::size_t t, std::size_t j) {
+                return unique[t].second < j;
+                });
+            if (it != tails.begin()) {
+                prev[i] = *std::prev(it);
+            }
+            if (it == tails.end()) {
+                tails.push_back(i);
+            } else {
+                *it = i;
+            }
+        }
+        std::vector<std::pair<std::size_t, std::size_t>> anchors;
+        for (std::size_t i = tails.empty() ? std::size_t(-1) : tails.back();
+             i != std::size_t(-1);
+             i = prev[i])
+        {
+            anchors.push_back(unique[i]);
+        }
+        std::reverse(anchors.begin(), anchors.end());
+        return anchors;
+    }
+
+    // Text spanned by a range of lines
+    std::string_view
+    line_range(
+        std::vector<std::string_view> const &lines,
+        std::size_t first,
+        std::size_t last) {
+        if (first == last) {
+            return {};
+        }
+        return std::string_view(
+            lines[first].data(),
+            lines[last - 1].data() + lines[last - 1].size()
+                - lines[first].data());
+    }
+
+    // A pair of ranges of lines that differ in two strings
+    using hunk = std::pair<std::string_view, std::string_view>;
+
+    // Find the hunks between lines that appear once in each string
+    /*
+     * Lines appearing exactly once in both strings anchor the alignment,
+     * and equal lines around each hunk are skipped. Only the remaining
+     * hunks need to be aligned, and their distances are summed.
+     */
+    std::vector<hunk>
+    line_hunks(std::string_view s1, std::string_view s2) {
+        std::vector<std::string_view> const a = split_lines(s1);
+        std::vector<std::string_view> const b = split_lines(s2);
+        std::vector<std::pair<std::size_t, std::size_t>> anchors
+            = unique_line_anchors(a, b);
+        anchors.emplace_back(a.size(), b.size());
+
+        std::vector<hunk> hunks;
+        std::size_t a_begin = 0;
+        std::size_t b_begin = 0;
+        for (auto const &[a_anchor, b_anchor]: anchors) {
+            // Skip the equal lines around the hunk
+            std::size_t a_end = a_anchor;
+            std::size_t b_end = b_anchor;
+            while (a_begin < a_end && b_begin < b_end
+                   && a[a_begin] == b[b_begin])
+            {
+                ++a_begin;
+                ++b_begin;
+            }
+            while (a_begin < a_end && b_begin < b_end
+                   && a[a_end - 1] == b[b_end - 1])
+            {
+                --a_end;
+                --b_end;
+            }
+            if (a_begin != a_end || b_begin != b_end) {
+                hunks.emplace_back(
+                    line_range(a, a_begin, a_end),
+                    line_range(b, b_begin, b_end));
+            }
+            a_begin = a_anchor + 1;
+            b_begin = b_anchor + 1;
+        }
+        return hunks;
+    }
+
+    // Align the hunks between lines that appear once in each string
+    std::size_t
+    line_anchored_distance(
+        std::string_view s1,
+        std::string_view s2,
+        std::size_t bound,
+        std::size_t max_bytes) {
+        std::size_t total = 0;
+        for (auto const &[h1, h2]: line_hunks(s1, s2)) {
+            std::size_t const d = windowed_align(
+                h1,
+                h2,
+                bound == std::size_t(-1) ? bound : bound - total,
+                max_bytes);
+            if (d == std::size_t(-1)) {
+                return d;
+            }
+            total += d;
+        }
+        return total;
+    }
+
+    // Lower bound for the distance from the counts of each character
+    /*
+     * Each edit changes the count of at most one character in each
+     * direction, so the characters missing from either string have to be
+     * edited.
+     */
+    std::size_t
+    count_lower_bound(std::string_view s1, std::string_view s2) {
+        std::array<std::ptrdiff_t, 256> counts{};
+        for (char c: s1) {
+            ++counts[static_cast<unsigned char>(c)];
+        }
+        for (char c: s2) {
+            --counts[static_cast<unsigned char>(c)];
+        }
+        std::size_t extra = 0;
+        std::size_t missing = 0;
+        for (std::ptrdiff_t n: counts) {
+            if (n > 0) {
+                extra += static_cast<std::size_t>(n);
+            } else {
+                missing += static_cast<std::size_t>(-n);
+            }
+        }
+        return (std::max)(extra, missing);
+    }
+
+    // Check the sum of the distances of the hunks between anchor lines
+    /*
+     * The sum is an upper bound for the distance, since the anchors might
+     * not be part of an optimal alignment. It's exact when it matches the
+     * lower bound from the counts of each character. Otherwise, the
+     * strings are aligned as a whole with the sum as the bound, or the sum
+     * is flagged as an upper bound if they don't fit in the memory limit.
+     */
+    levenshtein_estimate
+    exact_anchored_distance(
+        std::string_view s1,
+        std::string_view s2,
+        std::size_t bound,
+        std::size_t anchored,
+        std::size_t max_bytes) {
+        levenshtein_estimate r;
+        std::size_t const lower = count_lower_bound(s1, s2);
+        if (lower > bound) {
+            r.distance = std::size_t(-1);
+        } else if (anchored == lower) {
+            r.distance = anchored;
+        } else if (align_bytes(s1, s2) > max_bytes) {
+            r.distance = anchored;
+            r.upper_bound = true;
+        } else {
+            r.distance = align(s1, s2, (std::min)(bound, anchored));
+        }
+        return r;
+    }
+
+    // Hunks aligned by a group of tasks
+    struct parallel_hunks {
+        std::vector<hunk> hunks;
+        std::size_t bound{ std::size_t(-1) };
+        std::size_t max_bytes{ std::size_t(-1) };
+        std::atomic<std::size_t> total{ 0 };
+        std::atomic<bool> exceeded{ false };
+        std::mutex mutex;
+        std::condition_variable idle;
+        std::size_t next{ 0 };
+        std::size_t busy{ 0 };
+
+        // Align hunks until there are none left
+        void
+        work() {
+            for (;;) {
+                std::size_t i = 0;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (next == hunks.size() || exceeded) {
+                        return;
+                    }
+                    i = next++;
+                    ++busy;
+                }
+                std::size_t remaining = bound;
+                if (bound != std::size_t(-1)) {
+                    std::size_t const t = total;
+                    remaining = t > bound ? 0 : bound - t;
+                }
+                std::size_t const d = windowed_align(
+                    hunks[i].first,
+                    hunks[i].second,
+                    remaining,
+                    max_bytes);
+                if (d == std::size_t(-1)) {
+                    exceeded = true;
+                } else if ((total += d) > bound) {
+                    exceeded = true;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--busy == 0) {
+                    idle.notify_all();
+                }
+            }
+        }
+    };
+} // namespace
 
 std::size_t
 levenshtein_distance(std::string_view s1, std::string_view s2) {
-    auto r = edlibAlign(
-               s1.data(),
-               s1.size(),
-               s2.data(),
-               s2.size(),
-               edlibDefaultAlignConfig());
-    std::size_t d = r.editDistance;
-    edlibFreeAlignResult(r);
-    return d;
+    return levenshtein_distance(s1, s2, std::size_t(-1));
 }
 
 std::size_t
 levenshtein_distance(
-    const std::filesystem::path &p1,
-    const std::filesystem::path &p2) {
-    std::ifstream f1(p1);
-    std::ifstream f2(p2);
-    std::string
-        s1((std::istreambuf_iterator<char>(f1)),
-           std::istreambuf_iterator<char>());
-    std::string
-        s2((std::istreambuf_iterator<char>(f2)),
-           std::istreambuf_iterator<char>());
-    return levenshtein_distance(std::string_view(s1), std::string_view(s2));
+    std::string_view s1,
+    std::string_view s2,
+    std::size_t bound) {
+    // Most formatted files are identical to the original
+    if (s1 == s2) {
+        return 0;
+    }
+    if (s1.size() + s2.size() < line_diff_min_size) {
+        return align(s1, s2, bound);
+    }
+    std::size_t const anchored
+        = line_anchored_distance(s1, s2, bound, std::size_t(-1));
+    return exact_anchored_distance(s1, s2, bound, anchored, std::size_t(-1))
+        .distance;
+}
+
+levenshtein_estimate
+estimate_levenshtein_distance(
+    std::string_view s1,
+    std::string_view s2,
+    std::size_t bound,
+    std::size_t max_bytes,
+    task_spawner const &spawn,
+    std::size_t max_tasks) {
+    if (s1 == s2) {
+        return { 0, false };
+    }
+    if (s1.size() + s2.size() < line_diff_min_size) {
+        return { align(s1, s2, bound), false };
+    }
+    if (s1.size() + s2.size() < parallel_min_size || max_tasks < 2
+        || !spawn)
+    {
+        std::size_t const anchored
+            = line_anchored_distance(s1, s2, bound, max_bytes);
+        return exact_anchored_distance(s1, s2, bound, anchored, max_bytes);
+    }
+    auto state = std::make_shared<parallel_hunks>();
+    state->hunks = line_hunks(s1, s2);
+    state->bound = bound;
+    state->max_bytes = max_bytes;
+
+    // Helpers that start after all hunks are taken return right away, so
+    // the caller only waits for the hunks being aligned
+    std::size_t const helpers = (std::min)(
+        max_tasks - 1,
+        state->hunks.empty() ? 0 : state->hunks.size() - 1);
+    for (std::size_t i = 0; i < helpers; ++i) {
+        spawn([state] { state->work(); });
+    }
+    state->work();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->idle.wait(lock, [&state] { return state->busy == 0; });
+    return exact_anchored_distance(
+        s1,
+        s2,
+        bound,
+        state->exceeded ? std::size_t(-1) : state->total.load(),
+        max_bytes);
+}
+
+namespace {
+    constexpr std::size_t word_size = 64;
+
+    // A block of 64 rows of the alignment
+    struct myers_block {
+        // Positive and negative vertical deltas
+        std::uint64_t p{ ~std::uint64_t(0) };
+        std::uint64_t m{ 0 };
+        // Score of the last row of the block
+        std::ptrdiff_t score{ 0 };
+    };
+
+    // Advance a block by one column and return the horizontal delta of
+    // its last row
+    int
+    advance_block(myers_block &b, std::uint64_t eq, int hin) {
+        std::uint64_t const hin_is_neg = hin < 0 ? 1 : 0;
+        std::uint64_t const xv = eq | b.m;
+        eq |= hin_is_neg;
+        std::uint64_t const xh = (((eq & b.p) + b.p) ^ b.p) | eq;
+        std::uint64_t ph = b.m | ~(xh | b.p);
+        std::uint64_t mh = b.p & xh;
+        int hout = static_cast<int>(ph >> (word_size - 1))
+                   - static_cast<int>(mh >> (word_size - 1));
+        ph <<= 1;
+        mh <<= 1;
+        mh |= hin_is_neg;
+        ph |= hin > 0 ? 1 : 0;
+        b.p = mh | ~(xv | ph);
+        b.m = ph & xv;
+        return hout;
+    }
+} // namespace
+
+levenshtein_pattern::levenshtein_pattern(std::string_view original)
+    : original_(original) {
+    if (original.empty() || original.size() >= line_diff_min_size) {
+        return;
+    }
+    // Characters not in the original share the last row
+    std::array<bool, 256> present{};
+    for (char c: original) {
+        present[static_cast<unsigned char>(c)] = true;
+    }
+    std::uint16_t n_rows = 0;
+    for (std::size_t c = 0; c < present.size(); ++c) {
+        if (present[c]) {
+            rows_[c] = n_rows++;
+        }
+    }
+    for (std::size_t c = 0; c < present.size(); ++c) {
+        if (!present[c]) {
+            rows_[c] = n_rows;
+        }
+    }
+
+    // The original and the candidates are padded with the same symbol up
+    // to the end of the last block, which keeps the distance unchanged
+    pad_row_ = n_rows + 1;
+    n_rows += 2;
+    blocks_ = (original.size() + word_size - 1) / word_size;
+    peq_.assign(n_rows * blocks_, 0);
+    for (std::size_t i = 0; i < original.size(); ++i) {
+        std::size_t const row = rows_[static_cast<unsigned char>(original[i])];
+        peq_[row * blocks_ + i / word_size] |= std::uint64_t(1)
+                                               << (i % word_size);
+    }
+    std::size_t const padding = blocks_ * word_size - original.size();
+    if (padding != 0) {
+        peq_[pad_row_ * blocks_ + blocks_ - 1] = ~std::uint64_t(0)
+                                                 << (word_size - padding);
+    }
+}
+
+std::size_t
+levenshtein_pattern::distance(std::string_view candidate, std::size_t bound)
+    const {
+    if (candidate == original_) {
+        return 0;
+    }
+    if (blocks_ == 0) {
+        return levenshtein_distance(original_, candidate, bound);
+    }
+    std::size_t const length_diff = original_.size() > candidate.size()
+                                        ? original_.size() - candidate.size()
+                                        : candidate.size() - original_.size();
+    if (length_diff > bound) {
+        return std::size_t(-1);
+    }
+
+    // Widen the band until the distance is found or exceeds the bound
+    std::size_t const max_distance = (std::max)(
+        original_.size(),
+        candidate.size());
+    std::size_t k = (std::min)((std::max)(word_size, length_diff), bound);
+    for (;;) {
+        std::size_t const d = banded_distance(candidate, k);
+        if (d != std::size_t(-1) || k >= bound || k >= max_distance) {
+            return d;
+        }
+        k = (std::min)(k * 2, bound);
+    }
+}
+
+std::size_t
+levenshtein_pattern::banded_distance(
+    std::string_view candidate,
+    std::size_t band) const {
+    // Band limits follow edlib's global alignment, with the original along
+    // the rows and the candidate along the columns
+    auto const w = static_cast<std::ptrdiff_t>(word_size);
+    auto const n_blocks = static_cast<std::ptrdiff_t>(blocks_);
+    auto const rows = n_blocks * w;
+    auto const padding = rows - static_cast<std::ptrdiff_t>(original_.size());
+    auto const cols = static_cast<std::ptrdiff_t>(candidate.size())
+                      + padding;
+    auto k = static_cast<std::ptrdiff_t>(
+        (std::min)(band, static_cast<std::size_t>(rows + cols)));
+
+    thread_local std::vector<myers_block> blocks;
+    blocks.resize(blocks_);
+    for (std::ptrdiff_t b = 0; b < n_blocks; ++b) {
+        blocks[b] = myers_block{};
+        blocks[b].score = (b + 1) * w;
+    }
+    std::ptrdiff_t first = 0;
+    std::ptrdiff_t last = (std::min)((k + 1 + w - 1) / w, n_blocks) - 1;
+
+    for (std::ptrdiff_t c = 0; c < cols; ++c) {
+        std::size_t const row
+            = c < cols - padding
+                  ? rows_[static_cast<unsigned char>(candidate[c])]
+                  : pad_row_;
+        std::uint64_t const *eq = peq_.data() + row * blocks_;
+        int hout = 1;
+        for (std::ptrdiff_t b = first; b <= last; ++b) {
+            hout = advance_block(blocks[b], eq[b], hout);
+            blocks[b].score += hout;
+        }
+
+        // The remaining columns limit how much the distance can decrease
+        k = (std::min)(
+            k,
+            blocks[last].score
+                + (std::max)(cols - c - 1, rows - ((last + 1) * w - 1) - 1)
+                + (last == n_blocks - 1 ? 0 : 1));
+
+        // Add a block at the bottom
+        if (last + 1 < n_blocks
+            && !((last + 1) * w - 1
+                 > k - blocks[last].score + 2 * w - cols + c + rows))
+        {
+            ++last;
+            blocks[last] = myers_block{};
+            int const new_hout = advance_block(blocks[last], eq[last], hout);
+            blocks[last].score = blocks[last - 1].score - hout + w
+                                 + new_hout;
+        }
+
+        // Remove blocks at the bottom and at the top. Unlike edlib, the
+        // limits keep the row above each block, through which the best
+        // path might pass, so a distance equal to k is still found.
+        while (last >= first
+               && (blocks[last].score > k + w
+                   || (last + 1) * w - 1
+                          > k - blocks[last].score + 2 * w - cols + c
+                                + rows))
+        {
+            --last;
+        }
+        while (first <= last
+               && (blocks[first].score > k + w
+                   || (first + 1) * w - 1
+                          < blocks[first].score - k - cols + rows + c))
+        {
+            ++first;
+        }
+        if (last < first) {
+            return std::size_t(-1);
+        }
+    }
+    if (last != n_blocks - 1 || blocks[last].score > k) {
+        return std::size_t(-1);
+    }
+    return static_cast<std::size_t>(blocks[last].score);
 }
@@ -8,17 +8,127 @@
 #ifndef CLANG_UNFORMAT_LEVENSHTEIN_HPP
 #define CLANG_UNFORMAT_LEVENSHTEIN_HPP
 
-#include <filesystem>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string_view>
+#include <vector>
 
 /// Levenshtein distance between two strings
+/**
+ * Large strings are first compared line by line. Lines that appear once in
+ * each string anchor the alignment, and only the hunks of lines between
+ * them that differ are aligned. The sum of their distances is exact when it
+ * matches a lower bound from the counts of each character, which is usual
+ * for formatted files. Otherwise, the strings are aligned as a whole with
+ * the sum as the bound.
+ */
 std::size_t
 levenshtein_distance(std::string_view s1, std::string_view s2);
 
-/// Levenshtein distance between the contents of two files
+/// Levenshtein distance between two strings, if it's within a bound
+/**
+ * The alignment stops as soon as the distance is known to exceed the bound,
+ * which makes strings that are far apart much cheaper to compare.
+ *
+ * @return The distance, or std::size_t(-1) if it exceeds the bound
+ */
 std::size_t
 levenshtein_distance(
-    const std::filesystem::path &p1,
-    const std::filesystem::path &p2);
+    std::string_view s1,
+    std::string_view s2,
+    std::size_t bound);
+
+/// Function that runs a task on another thread
+using task_spawner = std::function<void(std::function<void()>)>;
+
+/// A Levenshtein distance that might only be an upper bound
+struct levenshtein_estimate {
+    /// The distance, or std::size_t(-1) if it exceeds the bound
+    std::size_t distance{ 0 };
+    /// Whether the strings didn't fit in the memory limit and the distance
+    /// could not be proven exact
+    bool upper_bound{ false };
+};
+
+/// Levenshtein distance between two strings with limited memory and tasks
+/**
+ * Large strings are split into hunks at lines that appear once in each
+ * string, as with levenshtein_distance. Hunks whose alignment would need
+ * more than `max_bytes` are split into windows at line breaks, and each
+ * window is aligned with the window at the same relative position of the
+ * other hunk. A sum that isn't proven exact is checked by aligning the
+ * strings as a whole, or flagged as an upper bound if that would need more
+ * than `max_bytes`.
+ *
+ * Very large strings have their hunks aligned by the calling thread and by
+ * up to `max_tasks - 1` tasks started with `spawn`. The caller only waits
+ * for hunks that are already being aligned, so the tasks might run on the
+ * same thread pool as the caller.
+ */
+levenshtein_estimate
+estimate_levenshtein_distance(
+    std::string_view s1,
+    std::string_view s2,
+    std::size_t bound,
+    std::size_t max_bytes,
+    task_spawner const &spawn,
+    std::size_t max_tasks);
+
+/// An original string compared with many candidate strings
+/**
+ * The bit masks of the original string used by the bit-parallel
+ * alignment are built once and reused for every candidate. The work
+ * buffers of the alignment are reused by each thread.
+ *
+ * Large strings are compared line by line, as with levenshtein_distance.
+ *
+ * The pattern refers to the original string, which should outlive it.
+ */
+class levenshtein_pattern {
+public:
+    /// Constructor
+    explicit levenshtein_pattern(std::string_view original);
+
+    /// Levenshtein distance from the original string to a candidate
+    /**
+     * @return The distance, or std::size_t(-1) if it exceeds the bound
+     */
+    std::size_t
+    distance(std::string_view candidate, std::size_t bound = std::size_t(-1))
+        const;
+
+    /// Check if the original is small enough for the bit masks
+    /**
+     * Other originals are compared with levenshtein_distance.
+     */
+    bool
+    bit_parallel() const {
+        return blocks_ != 0;
+    }
+
+    /// Memory used by the bit masks
+    std::size_t
+    bytes() const {
+        return peq_.size() * sizeof(std::uint64_t);
+    }
+
+private:
+    // Align with a band of k cells around the diagonal
+    std::size_t
+    banded_distance(std::string_view candidate, std::size_t k) const;
+
+    std::string_view original_;
+    // Number of 64-bit blocks spanning the original, or 0 if it's aligned
+    // with levenshtein_distance
+    std::size_t blocks_{ 0 };
+    // Row of each character in the bit masks
+    std::array<std::uint16_t, 256> rows_{};
+    // Row of the symbol padding the last block
+    std::size_t pad_row_{ 0 };
+    // Bit masks of the positions of each character in the original
+    std::vector<std::uint64_t> peq_;
+};
 
 #endif // CLANG_UNFORMAT_LEVENSHTEIN_HPP
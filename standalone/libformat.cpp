@@ -0,0 +1,120 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "libformat.hpp"
+#include <clang/Basic/Version.h>
+#include <clang/Format/Format.h>
+#include <clang/Tooling/Core/Replacement.h>
+#include <llvm/Support/Error.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace format = clang::format;
+namespace tooling = clang::tooling;
+
+struct libformat_style::language_styles {
+    std::string text;
+    std::mutex mutex;
+    std::map<int, std::shared_ptr<const format::FormatStyle>> styles;
+};
+
+std::optional<libformat_style>
+libformat_style::parse(std::string_view style) {
+    auto s = std::make_shared<format::FormatStyle>(
+        format::getLLVMStyle(format::FormatStyle::LK_Cpp));
+    std::error_code ec = format::parseConfiguration(
+        llvm::StringRef(style.data(), style.size()),
+        s.get());
+    if (ec) {
+        return std::nullopt;
+    }
+    libformat_style r;
+    r.style_ = std::move(s);
+    r.languages_ = std::make_shared<language_styles>();
+    r.languages_->text = std::string(style);
+    return r;
+}
+
+std::shared_ptr<const format::FormatStyle>
+libformat_style::style_for(int language) const {
+    auto const kind = static_cast<format::FormatStyle::LanguageKind>(language);
+    if (kind == format::FormatStyle::LK_Cpp) {
+        return style_;
+    }
+    std::lock_guard<std::mutex> lock(languages_->mutex);
+    auto it = languages_->styles.find(language);
+    if (it != languages_->styles.end()) {
+        return it->second;
+    }
+    // A style whose language is set only applies to that language
+    auto s = std::make_shared<format::FormatStyle>(format::getLLVMStyle(kind));
+    std::error_code ec = format::parseConfiguration(
+        languages_->text,
+        s.get());
+    if (ec) {
+        s.reset();
+    }
+    languages_->styles.emplace(language, s);
+    return s;
+}
+
+std::optional<std::string>
+libformat_style::format(std::string_view code, std::string_view filename)
+    const {
+    llvm::StringRef code_ref(code.data(), code.size());
+    llvm::StringRef filename_ref(filename.data(), filename.size());
+    std::shared_ptr<const format::FormatStyle> style = style_for(
+        format::guessLanguage(filename_ref, code_ref));
+    if (!style) {
+        return std::nullopt;
+    }
+    std::vector<tooling::Range> ranges{
+        tooling::Range(0, static_cast<unsigned>(code.size()))
+    };
+
+    // Sort includes
+    tooling::Replacements include_replaces
+        = format::sortIncludes(*style, code_ref, ranges, filename_ref);
+    llvm::Expected<std::string> sorted = tooling::applyAllReplacements(
+        code_ref,
+        include_replaces);
+    if (!sorted) {
+        llvm::consumeError(sorted.takeError());
+        return std::nullopt;
+    }
+    ranges = tooling::calculateRangesAfterReplacements(
+        include_replaces,
+        ranges);
+
+    // Format code
+    tooling::Replacements format_replaces
+        = format::reformat(*style, *sorted, ranges, filename_ref);
+    llvm::Expected<std::string> formatted = tooling::applyAllReplacements(
+        *sorted,
+        format_replaces);
+    if (!formatted) {
+        llvm::consumeError(formatted.takeError());
+        return std::nullopt;
+    }
+    return std::move(*formatted);
+}
+
+std::string
+libformat_style::dump() const {
+    return format::configurationAsText(*style_);
+}
+
+std::size_t
+libformat_version() {
+    return CLANG_VERSION_MAJOR;
+}
+
+std::string
+libformat_full_version() {
+    return clang::getClangFullVersion();
+}
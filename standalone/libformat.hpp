@@ -0,0 +1,76 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_LIBFORMAT_HPP
+#define CLANG_UNFORMAT_LIBFORMAT_HPP
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace clang::format {
+    struct FormatStyle;
+} // namespace clang::format
+
+/// A clang-format style parsed by clang's Format library
+/**
+ * This is only available when clang-unformat is built with the
+ * CLANG_UNFORMAT_LIBFORMAT CMake option. Formatting with a parsed style
+ * happens in-process, without spawning clang-format or parsing the
+ * configuration again for each file.
+ */
+class libformat_style {
+public:
+    /// Parse a YAML style, such as the one returned by inline_style
+    /**
+     * @return The parsed style or std::nullopt if the library does not
+     * support one of the options or values in the style
+     */
+    static std::optional<libformat_style>
+    parse(std::string_view style);
+
+    /// Format the code as if it were the contents of the specified file
+    /**
+     * The language of the file is guessed from its name and contents, and
+     * the style is parsed for that language, as in clang-format. Includes
+     * are sorted before the code is formatted.
+     *
+     * @return The formatted code or std::nullopt if formatting failed or
+     * the style does not apply to the language of the file
+     */
+    std::optional<std::string>
+    format(std::string_view code, std::string_view filename) const;
+
+    /// All options of the style, as printed by clang-format --dump-config
+    std::string
+    dump() const;
+
+private:
+    struct language_styles;
+
+    // Style parsed for a language, or nullptr if it doesn't apply to it
+    std::shared_ptr<const clang::format::FormatStyle>
+    style_for(int language) const;
+
+    // Style parsed for C++
+    std::shared_ptr<const clang::format::FormatStyle> style_;
+
+    // Styles of other languages, which are parsed when first used
+    std::shared_ptr<language_styles> languages_;
+};
+
+/// Major version of the linked clang Format library
+std::size_t
+libformat_version();
+
+/// Full version of the linked clang Format library
+std::string
+libformat_full_version();
+
+#endif // CLANG_UNFORMAT_LIBFORMAT_HPP
@@ -0,0 +1,170 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "process_launcher.hpp"
+#ifdef _WIN32
+#    include <boost/process.hpp>
+#    include <iterator>
+#else
+#    include <cerrno>
+#    include <fcntl.h>
+#    include <spawn.h>
+#    include <sys/wait.h>
+#    include <unistd.h>
+extern char **environ;
+#endif
+
+process_launcher::process_launcher(std::filesystem::path executable)
+    : executable_(std::move(executable)),
+      executable_str_(executable_.string()) {}
+
+#ifdef _WIN32
+std::pair<int, std::string>
+process_launcher::run(const std::vector<std::string> &args) const {
+    namespace process = boost::process;
+    process::ipstream is;
+    std::error_code ec;
+    process::child
+        c(executable_.c_str(),
+          process::args(args),
+          process::std_in < process::null,
+          process::std_out > is,
+          process::std_err > process::null,
+          ec);
+    if (ec) {
+        return { -1, {} };
+    }
+    std::string output(
+        (std::istreambuf_iterator<char>(is)),
+        std::istreambuf_iterator<char>());
+    c.wait();
+    return { c.exit_code(), std::move(output) };
+}
+#else
+namespace {
+    // Create a pipe whose ends are closed on exec
+    bool
+    make_pipe(int (&fds)[2]) {
+#    ifdef __linux__
+        return ::pipe2(fds, O_CLOEXEC) == 0;
+#    else
+        if (::pipe(fds) != 0) {
+            return false;
+        }
+        ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        return true;
+#    endif
+    }
+} // namespace
+
+std::optional<process_launcher::child>
+process_launcher::spawn(const std::vector<std::string> &args, bool with_input)
+    const {
+    std::vector<char *> argv;
+    argv.reserve(args.size() + 2);
+    argv.push_back(const_cast<char *>(executable_str_.c_str()));
+    for (auto const &arg: args) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    int in[2] = { -1, -1 };
+    int out[2] = { -1, -1 };
+    if ((with_input && !make_pipe(in)) || !make_pipe(out)) {
+        for (int fd: { in[0], in[1], out[0], out[1] }) {
+            if (fd != -1) {
+                ::close(fd);
+            }
+        }
+        return std::nullopt;
+    }
+
+    // dup2 clears the close-on-exec flag of the standard streams
+    posix_spawn_file_actions_t actions;
+    ::posix_spawn_file_actions_init(&actions);
+    if (with_input) {
+        ::posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+    } else {
+        ::posix_spawn_file_actions_addopen(
+            &actions,
+            STDIN_FILENO,
+            "/dev/null",
+            O_RDONLY,
+            0);
+    }
+    ::posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    ::posix_spawn_file_actions_addopen(
+        &actions,
+        STDERR_FILENO,
+        "/dev/null",
+        O_WRONLY,
+        0);
+    posix_spawnattr_t attr;
+    ::posix_spawnattr_init(&attr);
+#    ifdef POSIX_SPAWN_USEVFORK
+    ::posix_spawnattr_setflags(&attr, POSIX_SPAWN_USEVFORK);
+#    endif
+
+    child c;
+    int const err = ::posix_spawn(
+        &c.pid,
+        executable_str_.c_str(),
+        &actions,
+        &attr,
+        argv.data(),
+        environ);
+    ::posix_spawn_file_actions_destroy(&actions);
+    ::posix_spawnattr_destroy(&attr);
+
+    // Close the ends used by the child
+    if (with_input) {
+        ::close(in[0]);
+    }
+    ::close(out[1]);
+    if (err != 0) {
+        if (with_input) {
+            ::close(in[1]);
+        }
+        ::close(out[0]);
+        return std::nullopt;
+    }
+    c.input = in[1];
+    c.output = out[0];
+    return c;
+}
+
+std::pair<int, std::string>
+process_launcher::run(const std::vector<std::string> &args) const {
+    std::optional<child> c = spawn(args, false);
+    if (!c) {
+        return { -1, {} };
+    }
+    std::string output;
+    char buffer[4096];
+    for (;;) {
+        ::ssize_t n = ::read(c->output, buffer, sizeof(buffer));
+        if (n > 0) {
+            output.append(buffer, static_cast<std::size_t>(n));
+        } else if (n == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    ::close(c->output);
+    int status = 0;
+    while (::waitpid(c->pid, &status, 0) == -1 && errno == EINTR) {}
+    return { exit_code_from_status(status), std::move(output) };
+}
+
+int
+exit_code_from_status(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    return -1;
+}
+#endif
@@ -0,0 +1,85 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_PROCESS_LAUNCHER_HPP
+#define CLANG_UNFORMAT_PROCESS_LAUNCHER_HPP
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#    include <sys/types.h>
+#endif
+
+/// Launches processes of a single executable
+/**
+ * On POSIX systems, children are created with posix_spawn, which avoids
+ * copying the address space of the parent. The executable path is
+ * converted once and the environment of the parent is reused as is.
+ *
+ * All pipe ends created by the launcher are closed on exec, so children
+ * never inherit the pipes of other children.
+ */
+class process_launcher {
+public:
+    /// Constructor
+    explicit process_launcher(std::filesystem::path executable);
+
+    /// Path to the executable
+    const std::filesystem::path &
+    executable() const {
+        return executable_;
+    }
+
+    /// Run the executable and wait for it to exit
+    /**
+     * @return The exit code and the standard output of the child. The exit
+     * code is -1 if the child cannot be launched.
+     */
+    std::pair<int, std::string>
+    run(const std::vector<std::string> &args) const;
+
+#ifndef _WIN32
+    /// A child spawned with pipes to its standard input and output
+    struct child {
+        ::pid_t pid{ -1 };
+
+        /// Write end of the standard input, or -1 if there's no input
+        int input{ -1 };
+
+        /// Read end of the standard output
+        int output{ -1 };
+    };
+
+    /// Spawn the executable without waiting for it
+    /**
+     * The standard error of the child is discarded. If `with_input` is
+     * false, the standard input of the child is empty.
+     *
+     * The caller owns the pipe ends and should reap the child.
+     */
+    std::optional<child>
+    spawn(const std::vector<std::string> &args, bool with_input) const;
+#endif
+
+private:
+    std::filesystem::path executable_;
+    std::string executable_str_;
+};
+
+#ifndef _WIN32
+/// Get the exit code of a child from the status reported by waitpid
+/**
+ * The exit code is -1 if the child was terminated by a signal.
+ */
+int
+exit_code_from_status(int status);
+#endif
+
+#endif // CLANG_UNFORMAT_PROCESS_LAUNCHER_HPP
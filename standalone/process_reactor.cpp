@@ -0,0 +1,384 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "process_reactor.hpp"
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#ifdef _WIN32
+#    include <boost/asio/read.hpp>
+#    include <boost/process.hpp>
+#else
+#    include <boost/asio/posix/stream_descriptor.hpp>
+#    include <signal.h>
+#    include <sys/wait.h>
+#endif
+#include <algorithm>
+#include <future>
+#include <system_error>
+
+#ifdef _WIN32
+namespace process = boost::process;
+
+struct process_reactor::child_state {
+    explicit child_state(boost::asio::io_context &ioc)
+        : out(ioc), timer(ioc) {}
+
+    process::async_pipe out;
+    std::string output;
+    process::child child;
+    handler_type handler;
+    int exit_code{ -1 };
+    // The child exited and its output reached the end
+    std::size_t pending_events{ 2 };
+    boost::asio::steady_timer timer;
+    std::shared_ptr<time_budget> budget;
+    bool timed_out{ false };
+};
+#else
+namespace {
+    // Size of the buffers used to read the output of the children
+    constexpr std::size_t read_buffer_size = 64 * 1024;
+} // namespace
+
+struct process_reactor::child_state {
+    explicit child_state(boost::asio::io_context &ioc)
+        : in(ioc), out(ioc), timer(ioc) {}
+
+    ::pid_t pid{ -1 };
+    boost::asio::posix::stream_descriptor in;
+    boost::asio::posix::stream_descriptor out;
+    std::unique_ptr<char[]> buffer;
+    std::string output;
+    handler_type handler;
+    int exit_code{ -1 };
+    // The child exited and its output reached the end
+    std::size_t pending_events{ 2 };
+    boost::asio::steady_timer timer;
+    std::shared_ptr<time_budget> budget;
+    bool timed_out{ false };
+    // The child was reaped and its pid might be reused
+    bool exited{ false };
+};
+#endif
+
+process_reactor::process_reactor(
+    std::filesystem::path executable,
+    std::size_t max_children)
+    : launcher_(std::move(executable)),
+      max_children_((std::max)(max_children, std::size_t(1))),
+      work_(boost::asio::make_work_guard(ioc_))
+#ifndef _WIN32
+      ,
+      sigchld_(ioc_, SIGCHLD)
+#endif
+{
+#ifndef _WIN32
+    // A child might exit before consuming all of its input
+    ::signal(SIGPIPE, SIG_IGN);
+    wait_for_exits();
+#endif
+    thread_ = std::thread([this] { ioc_.run(); });
+}
+
+process_reactor::~process_reactor() {
+#ifndef _WIN32
+    // The pending SIGCHLD wait would keep the reactor running
+    boost::asio::post(ioc_, [this] { sigchld_.cancel(); });
+#endif
+    work_.reset();
+    thread_.join();
+}
+
+void
+process_reactor::async_run(
+    std::vector<std::string> args,
+    std::string_view input,
+    handler_type handler,
+    std::chrono::steady_clock::duration timeout,
+    std::shared_ptr<time_budget> budget) {
+    boost::asio::post(
+        ioc_,
+        [this,
+         r = request{ std::move(args),
+                      input,
+                      std::move(handler),
+                      timeout,
+                      std::move(budget) }]() mutable {
+        // Requests already queued go first
+        if (pending_.empty() && running_ < max_children_) {
+            launch(std::move(r));
+        } else {
+            pending_.push_back(std::move(r));
+        }
+        });
+}
+
+std::pair<int, std::string>
+process_reactor::run(std::vector<std::string> args, std::string_view input) {
+    std::promise<std::pair<int, std::string>> result;
+    async_run(
+        std::move(args),
+        input,
+        [&result](int exit_code, std::string output) {
+        result.set_value({ exit_code, std::move(output) });
+        });
+    return result.get_future().get();
+}
+
+void
+process_reactor::drain() {
+    std::promise<void> done;
+    boost::asio::post(ioc_, [&done] { done.set_value(); });
+    done.get_future().wait();
+}
+
+void
+process_reactor::cancel(std::shared_ptr<time_budget> budget) {
+    boost::asio::post(ioc_, [this, budget = std::move(budget)] {
+        budget->deadline = std::chrono::steady_clock::now();
+        for (auto const &child: children_) {
+#ifdef _WIN32
+            std::shared_ptr<child_state> const &s = child;
+#else
+            std::shared_ptr<child_state> const &s = child.second;
+#endif
+            if (s->budget == budget) {
+                kill(*s);
+            }
+        }
+    });
+}
+
+#ifdef _WIN32
+void
+process_reactor::launch(request r) {
+    auto s = std::make_shared<child_state>(ioc_);
+    s->handler = std::move(r.handler);
+    s->budget = r.budget;
+    ++running_;
+    if (budget_exhausted(r)) {
+        s->pending_events = 1;
+        s->timed_out = true;
+        complete(s);
+        return;
+    }
+    std::error_code ec;
+    auto on_exit = process::on_exit(
+        [this, s](int exit_code, std::error_code const &) {
+        s->exit_code = exit_code;
+        complete(s);
+        });
+    if (r.input.empty()) {
+        s->child = process::child(
+            launcher_.executable().c_str(),
+            process::args(r.args),
+            process::std_in < process::null,
+            process::std_out > s->out,
+            process::std_err > process::null,
+            ioc_,
+            on_exit,
+            ec);
+    } else {
+        s->child = process::child(
+            launcher_.executable().c_str(),
+            process::args(r.args),
+            process::std_in < boost::asio::buffer(
+                r.input.data(),
+                r.input.size()),
+            process::std_out > s->out,
+            process::std_err > process::null,
+            ioc_,
+            on_exit,
+            ec);
+    }
+    if (ec) {
+        s->pending_events = 1;
+        s->exit_code = -1;
+        complete(s);
+        return;
+    }
+    children_.insert(s);
+    start_timer(s, r);
+    boost::asio::async_read(
+        s->out,
+        boost::asio::dynamic_buffer(s->output),
+        [this, s](boost::system::error_code const &, std::size_t) {
+        complete(s);
+        });
+}
+#else
+void
+process_reactor::launch(request r) {
+    auto s = std::make_shared<child_state>(ioc_);
+    s->handler = std::move(r.handler);
+    s->budget = r.budget;
+    ++running_;
+    if (budget_exhausted(r)) {
+        s->pending_events = 1;
+        s->timed_out = true;
+        complete(s);
+        return;
+    }
+    std::optional<process_launcher::child> c
+        = launcher_.spawn(r.args, !r.input.empty());
+    if (!c) {
+        s->pending_events = 1;
+        s->exit_code = -1;
+        complete(s);
+        return;
+    }
+    s->pid = c->pid;
+    children_.emplace(c->pid, s);
+    start_timer(s, r);
+
+    // Write the input and close the pipe so the child sees its end
+    if (c->input != -1) {
+        s->in.assign(c->input);
+        boost::asio::async_write(
+            s->in,
+            boost::asio::buffer(r.input.data(), r.input.size()),
+            [s](boost::system::error_code const &, std::size_t) {
+            boost::system::error_code ec;
+            s->in.close(ec);
+            });
+    }
+
+    // Read the output with a pooled buffer
+    s->out.assign(c->output);
+    if (free_buffers_.empty()) {
+        s->buffer = std::make_unique<char[]>(read_buffer_size);
+    } else {
+        s->buffer = std::move(free_buffers_.back());
+        free_buffers_.pop_back();
+    }
+    s->output.reserve(r.input.size());
+    read_output(s);
+}
+
+void
+process_reactor::read_output(std::shared_ptr<child_state> const &s) {
+    s->out.async_read_some(
+        boost::asio::buffer(s->buffer.get(), read_buffer_size),
+        [this, s](boost::system::error_code const &ec, std::size_t n) {
+        s->output.append(s->buffer.get(), n);
+        if (!ec) {
+            read_output(s);
+            return;
+        }
+        boost::system::error_code close_ec;
+        s->out.close(close_ec);
+        free_buffers_.push_back(std::move(s->buffer));
+        complete(s);
+        });
+}
+
+void
+process_reactor::wait_for_exits() {
+    sigchld_.async_wait([this](boost::system::error_code const &ec, int) {
+        if (ec) {
+            return;
+        }
+        reap_children();
+        wait_for_exits();
+    });
+}
+
+void
+process_reactor::reap_children() {
+    // Signals might be merged, so every running child is checked
+    for (auto it = children_.begin(); it != children_.end();) {
+        int status = 0;
+        ::pid_t const pid = ::waitpid(it->first, &status, WNOHANG);
+        if (pid == 0) {
+            ++it;
+            continue;
+        }
+        std::shared_ptr<child_state> s = std::move(it->second);
+        it = children_.erase(it);
+        s->exited = true;
+        s->exit_code = pid == -1 ? -1 : exit_code_from_status(status);
+        complete(s);
+    }
+}
+#endif
+
+bool
+process_reactor::budget_exhausted(request const &r) {
+    if (!r.budget) {
+        return false;
+    }
+    auto const now = std::chrono::steady_clock::now();
+    if (!r.budget->deadline
+        && r.budget->limit > std::chrono::steady_clock::duration::zero())
+    {
+        r.budget->deadline = now + r.budget->limit;
+    }
+    return r.budget->deadline && *r.budget->deadline <= now;
+}
+
+void
+process_reactor::start_timer(
+    std::shared_ptr<child_state> const &s,
+    request const &r) {
+    using clock = std::chrono::steady_clock;
+    clock::time_point expiry = clock::time_point::max();
+    if (r.timeout > clock::duration::zero()) {
+        expiry = clock::now() + r.timeout;
+    }
+    if (r.budget && r.budget->deadline) {
+        expiry = (std::min)(expiry, *r.budget->deadline);
+    }
+    if (expiry == clock::time_point::max()) {
+        return;
+    }
+    s->timer.expires_at(expiry);
+    s->timer.async_wait([this, s](boost::system::error_code const &ec) {
+        if (!ec) {
+            kill(*s);
+        }
+    });
+}
+
+void
+process_reactor::kill(child_state &s) {
+#ifdef _WIN32
+    std::error_code ec;
+    if (s.child.running(ec)) {
+        s.timed_out = true;
+        s.child.terminate(ec);
+    }
+#else
+    if (!s.exited) {
+        s.timed_out = true;
+        ::kill(s.pid, SIGKILL);
+    }
+#endif
+}
+
+void
+process_reactor::complete(std::shared_ptr<child_state> const &s) {
+    if (--s->pending_events != 0) {
+        return;
+    }
+    --running_;
+    s->timer.cancel();
+#ifdef _WIN32
+    children_.erase(s);
+#endif
+    handler_type handler = std::move(s->handler);
+    handler(s->timed_out ? timed_out : s->exit_code, std::move(s->output));
+    // The exit handler might be running inside the loop where children
+    // are reaped, so new children are only launched after it returns
+    boost::asio::post(ioc_, [this] {
+        while (!pending_.empty() && running_ < max_children_) {
+            request next = std::move(pending_.front());
+            pending_.pop_front();
+            launch(std::move(next));
+        }
+    });
+}
@@ -0,0 +1,198 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_PROCESS_REACTOR_HPP
+#define CLANG_UNFORMAT_PROCESS_REACTOR_HPP
+
+#include <process_launcher.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <chrono>
+#include <optional>
+#ifndef _WIN32
+#    include <boost/asio/signal_set.hpp>
+#endif
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/// Launches and reaps child processes asynchronously
+/**
+ * Processes are launched, fed and reaped by an asio reactor running on its
+ * own thread, so no other thread is blocked while a child runs. At most
+ * `max_children` children run at the same time and further requests wait
+ * in a queue, in the order they were made.
+ *
+ * Completion handlers run on the reactor thread and should post any
+ * expensive work to another executor.
+ *
+ * On POSIX systems, children are spawned with a process_launcher and
+ * reaped when the reactor receives SIGCHLD. The buffers used to read their
+ * output are pooled.
+ */
+class process_reactor {
+public:
+    /// Handler called with the exit code and the standard output of a child
+    using handler_type = std::function<void(int, std::string)>;
+
+    /// Exit code of children killed because they ran out of time
+    static constexpr int timed_out = -2;
+
+    /// A time limit shared by a group of children
+    /**
+     * The time starts counting when the first child of the group is
+     * launched. Children still running when the time is over are killed,
+     * and children launched after that are not started at all.
+     *
+     * A budget with no limit only ends when it's cancelled.
+     *
+     * Budgets are only accessed from the reactor thread.
+     */
+    struct time_budget {
+        explicit time_budget(std::chrono::steady_clock::duration l)
+            : limit(l) {}
+
+        /// Time limit, or zero for no limit
+        std::chrono::steady_clock::duration limit;
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+    };
+
+    /// Constructor
+    process_reactor(std::filesystem::path executable, std::size_t max_children);
+
+    process_reactor(process_reactor const &) = delete;
+
+    process_reactor &
+    operator=(process_reactor const &) = delete;
+
+    /// Destructor
+    /**
+     * Stops the reactor without waiting for children that are still
+     * running or queued, whose handlers are never called. Callers should
+     * wait for the handlers of their requests and call drain() first.
+     */
+    ~process_reactor();
+
+    /// Run the executable with the specified arguments
+    /**
+     * @param args Command line arguments
+     * @param input Data written to the standard input of the child. The
+     * data should remain valid until the handler is called.
+     * @param handler Handler called when the child exits. If the child
+     * cannot be launched, the handler is called with exit code -1.
+     * @param timeout Maximum time the child might run, or zero for no limit
+     * @param budget Time limit shared with other children, if any
+     */
+    void
+    async_run(
+        std::vector<std::string> args,
+        std::string_view input,
+        handler_type handler,
+        std::chrono::steady_clock::duration timeout = {},
+        std::shared_ptr<time_budget> budget = {});
+
+    /// Run the executable and wait for the result
+    /**
+     * This function should not be called from the reactor thread.
+     */
+    std::pair<int, std::string>
+    run(std::vector<std::string> args, std::string_view input = {});
+
+    /// Wait for the handlers running on the reactor thread to return
+    /**
+     * Executors that handlers post work to should only be destroyed after
+     * this function returns.
+     *
+     * This function should not be called from the reactor thread.
+     */
+    void
+    drain();
+
+    /// End a time budget now
+    /**
+     * The children of the budget still running are killed and the ones
+     * not launched yet are not started. Their handlers are called with the
+     * `timed_out` exit code.
+     */
+    void
+    cancel(std::shared_ptr<time_budget> budget);
+
+private:
+    struct request {
+        std::vector<std::string> args;
+        std::string_view input;
+        handler_type handler;
+        std::chrono::steady_clock::duration timeout;
+        std::shared_ptr<time_budget> budget;
+    };
+
+    struct child_state;
+
+    // Launch a child on the reactor thread
+    void
+    launch(request r);
+
+    // Complete a child once it exited and its output is consumed
+    void
+    complete(std::shared_ptr<child_state> const &s);
+
+    // Start the time budget of the request and check if it's already over
+    static bool
+    budget_exhausted(request const &r);
+
+    // Kill the child when its time is over
+    void
+    start_timer(std::shared_ptr<child_state> const &s, request const &r);
+
+    // Kill a child that ran out of time
+    void
+    kill(child_state &s);
+
+#ifndef _WIN32
+    // Read the next chunk of the output of a child
+    void
+    read_output(std::shared_ptr<child_state> const &s);
+
+    // Wait for the next SIGCHLD
+    void
+    wait_for_exits();
+
+    // Reap the children that exited
+    void
+    reap_children();
+#endif
+
+    process_launcher launcher_;
+    std::size_t max_children_;
+    boost::asio::io_context ioc_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+        work_;
+
+    // Only accessed from the reactor thread
+    std::size_t running_{ 0 };
+    std::deque<request> pending_;
+#ifdef _WIN32
+    std::unordered_set<std::shared_ptr<child_state>> children_;
+#else
+    boost::asio::signal_set sigchld_;
+    std::unordered_map<::pid_t, std::shared_ptr<child_state>> children_;
+    std::vector<std::unique_ptr<char[]>> free_buffers_;
+#endif
+
+    std::thread thread_;
+};
+
+#endif // CLANG_UNFORMAT_PROCESS_REACTOR_HPP
@@ -0,0 +1,140 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "replacements.hpp"
+#include <charconv>
+
+namespace {
+    // Parse the value of an attribute of an element
+    std::optional<std::size_t>
+    attribute(std::string_view element, std::string_view name) {
+        std::size_t pos = 0;
+        for (;;) {
+            pos = element.find(name, pos);
+            if (pos == std::string_view::npos) {
+                return std::nullopt;
+            }
+            // The name should be a whole attribute name
+            std::size_t const value = pos + name.size();
+            if (pos > 0 && element[pos - 1] == ' '
+                && element.substr(value, 2) == "='")
+            {
+                std::size_t result = 0;
+                char const *first = element.data() + value + 2;
+                char const *last = element.data() + element.size();
+                auto [ptr, ec] = std::from_chars(first, last, result);
+                if (ec != std::errc() || ptr == last || *ptr != '\'') {
+                    return std::nullopt;
+                }
+                return result;
+            }
+            pos = value;
+        }
+    }
+
+    // Replace the XML entities in the text of an element
+    std::optional<std::string>
+    unescape(std::string_view text) {
+        std::string result;
+        result.reserve(text.size());
+        while (!text.empty()) {
+            std::size_t const amp = text.find('&');
+            result.append(text.substr(0, amp));
+            if (amp == std::string_view::npos) {
+                break;
+            }
+            text.remove_prefix(amp);
+            std::size_t const semicolon = text.find(';');
+            if (semicolon == std::string_view::npos) {
+                return std::nullopt;
+            }
+            std::string_view const entity = text.substr(1, semicolon - 1);
+            text.remove_prefix(semicolon + 1);
+            if (entity == "lt") {
+                result.push_back('<');
+            } else if (entity == "gt") {
+                result.push_back('>');
+            } else if (entity == "amp") {
+                result.push_back('&');
+            } else if (entity == "apos") {
+                result.push_back('\'');
+            } else if (entity == "quot") {
+                result.push_back('"');
+            } else if (entity.size() > 1 && entity[0] == '#') {
+                bool const hex = entity[1] == 'x';
+                std::string_view digits = entity.substr(hex ? 2 : 1);
+                unsigned code = 0;
+                auto [ptr, ec] = std::from_chars(
+                    digits.data(),
+                    digits.data() + digits.size(),
+                    code,
+                    hex ? 16 : 10);
+                if (ec != std::errc() || ptr != digits.data() + digits.size()
+                    || code > 0x7F)
+                {
+                    return std::nullopt;
+                }
+                result.push_back(static_cast<char>(code));
+            } else {
+                return std::nullopt;
+            }
+        }
+        return result;
+    }
+} // namespace
+
+std::optional<std::vector<replacement>>
+parse_replacements_xml(std::string_view xml, std::size_t file_size) {
+    constexpr std::string_view open_tag = "<replacement ";
+    constexpr std::string_view close_tag = "</replacement>";
+    if (xml.find("<replacements") == std::string_view::npos) {
+        return std::nullopt;
+    }
+    std::vector<replacement> result;
+    std::size_t pos = 0;
+    while ((pos = xml.find(open_tag, pos)) != std::string_view::npos) {
+        std::size_t const element_end = xml.find('>', pos);
+        if (element_end == std::string_view::npos) {
+            return std::nullopt;
+        }
+        std::string_view const element = xml.substr(pos, element_end - pos);
+        replacement r;
+        std::optional<std::size_t> offset = attribute(element, "offset");
+        std::optional<std::size_t> length = attribute(element, "length");
+        if (!offset || !length || *offset > file_size
+            || *length > file_size - *offset)
+        {
+            return std::nullopt;
+        }
+        r.offset = *offset;
+        r.length = *length;
+        // Each replacement should start after the end of the previous one
+        if (!result.empty()
+            && r.offset < result.back().offset + result.back().length)
+        {
+            return std::nullopt;
+        }
+        pos = element_end + 1;
+
+        // Empty replacements might be self-closing
+        if (element.back() != '/') {
+            std::size_t const text_end = xml.find(close_tag, pos);
+            if (text_end == std::string_view::npos) {
+                return std::nullopt;
+            }
+            std::optional<std::string> text = unescape(
+                xml.substr(pos, text_end - pos));
+            if (!text) {
+                return std::nullopt;
+            }
+            r.text = std::move(*text);
+            pos = text_end + close_tag.size();
+        }
+        result.push_back(std::move(r));
+    }
+    return result;
+}
@@ -0,0 +1,41 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_REPLACEMENTS_HPP
+#define CLANG_UNFORMAT_REPLACEMENTS_HPP
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// A change clang-format would make to a file
+struct replacement {
+    /// Offset of the replaced bytes in the original file
+    std::size_t offset{ 0 };
+
+    /// Number of replaced bytes
+    std::size_t length{ 0 };
+
+    /// Text replacing these bytes
+    std::string text;
+};
+
+/// Parse the output of clang-format --output-replacements-xml
+/**
+ * @param xml The output of clang-format
+ * @param file_size Size of the original file
+ *
+ * @return The replacements, or std::nullopt if the output is not valid,
+ * the replacements do not fit in the original file, or they are not
+ * sorted by offset without overlaps
+ */
+std::optional<std::vector<replacement>>
+parse_replacements_xml(std::string_view xml, std::size_t file_size);
+
+#endif // CLANG_UNFORMAT_REPLACEMENTS_HPP
@@ -0,0 +1,171 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "temp_slots.hpp"
+#include <fmt/format.h>
+#include <numeric>
+#include <system_error>
+#ifdef __linux__
+#    include <fcntl.h>
+#    include <linux/fs.h>
+#    include <sys/ioctl.h>
+#    include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Create a copy-on-write clone of the file, if the filesystem supports it
+    bool
+    reflink(const fs::path &from, const fs::path &to) {
+#if defined(__linux__) && defined(FICLONE)
+        int src = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+        if (src == -1) {
+            return false;
+        }
+        int dst = ::open(
+            to.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644);
+        if (dst == -1) {
+            ::close(src);
+            return false;
+        }
+        bool const ok = ::ioctl(dst, FICLONE, src) == 0;
+        ::close(src);
+        ::close(dst);
+        return ok;
+#else
+        (void) from;
+        (void) to;
+        return false;
+#endif
+    }
+} // namespace
+
+temp_slots::lease::lease(lease &&other) noexcept
+    : slots_(other.slots_), index_(other.index_) {
+    other.slots_ = nullptr;
+}
+
+temp_slots::lease::~lease() {
+    if (slots_) {
+        slots_->release(index_);
+    }
+}
+
+const fs::path &
+temp_slots::lease::path() const {
+    return slots_->slots_[index_].path;
+}
+
+void
+temp_slots::lease::mark_changed(std::size_t file) {
+    slots_->slots_[index_].changed.push_back(file);
+}
+
+void
+temp_slots::lease::mark_all_changed() {
+    slots_->slots_[index_].all_changed = true;
+}
+
+temp_slots::temp_slots(
+    const corpus &c,
+    const fs::path &temp,
+    std::size_t n,
+    bool allow_hardlinks)
+    : corpus_(c), allow_hardlinks_(allow_hardlinks), slots_(n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        slots_[i].path = temp / fmt::format("temp_{}", i);
+    }
+    available_.resize(n);
+    std::iota(available_.rbegin(), available_.rend(), std::size_t(0));
+}
+
+void
+temp_slots::async_acquire(handler_type handler) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (available_.empty()) {
+        waiting_.push_back(std::move(handler));
+        return;
+    }
+    std::size_t index = available_.back();
+    available_.pop_back();
+    lock.unlock();
+    handoff(index, handler);
+}
+
+void
+temp_slots::handoff(std::size_t index, handler_type &handler) {
+    lease l(this, index);
+    slot &s = slots_[index];
+    if (!s.initialized) {
+        initialize(s);
+    }
+    handler(std::move(l));
+}
+
+void
+temp_slots::release(std::size_t index) {
+    slot &s = slots_[index];
+    if (s.all_changed) {
+        s.initialized = false;
+    } else {
+        try {
+            for (std::size_t file: s.changed) {
+                restore(s, file);
+            }
+        }
+        catch (fs::filesystem_error const &) {
+            s.initialized = false;
+        }
+    }
+    s.all_changed = false;
+    s.changed.clear();
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (waiting_.empty()) {
+        available_.push_back(index);
+        return;
+    }
+    handler_type handler = std::move(waiting_.front());
+    waiting_.pop_front();
+    lock.unlock();
+    handoff(index, handler);
+}
+
+void
+temp_slots::initialize(slot &s) {
+    // Files from previous runs might have been changed and are restored too
+    for (std::size_t i = 0; i < corpus_.files().size(); ++i) {
+        fs::create_directories(
+            (s.path / corpus_.files()[i].relative).parent_path());
+        restore(s, i);
+    }
+    s.initialized = true;
+}
+
+void
+temp_slots::restore(slot &s, std::size_t file) {
+    fs::path const &relative = corpus_.files()[file].relative;
+    fs::path from = corpus_.input() / relative;
+    fs::path to = s.path / relative;
+    std::error_code ec;
+    fs::remove(to, ec);
+    if (allow_hardlinks_) {
+        fs::create_hard_link(from, to, ec);
+        if (!ec) {
+            return;
+        }
+    }
+    if (reflink_supported_) {
+        if (reflink(from, to)) {
+            return;
+        }
+        reflink_supported_ = false;
+    }
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing);
+}
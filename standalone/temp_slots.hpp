@@ -0,0 +1,132 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_TEMP_SLOTS_HPP
+#define CLANG_UNFORMAT_TEMP_SLOTS_HPP
+
+#include <corpus.hpp>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/// A fixed pool of temp directories holding copies of the eligible files
+/**
+ * Each slot is a directory with the same layout as the corpus. Only the
+ * eligible files are copied into a slot, and only the files clang-format
+ * changed are restored when the slot is released.
+ *
+ * Files are restored with hardlinks, when allowed, reflinks, when the
+ * filesystem supports them, or plain copies.
+ */
+class temp_slots {
+public:
+    /// A slot acquired by an evaluation task
+    /**
+     * The slot is released when the lease is destroyed.
+     */
+    class lease {
+    public:
+        lease(lease &&other) noexcept;
+
+        lease(lease const &) = delete;
+
+        lease &
+        operator=(lease const &) = delete;
+
+        lease &
+        operator=(lease &&) = delete;
+
+        ~lease();
+
+        /// Path of the slot directory
+        const std::filesystem::path &
+        path() const;
+
+        /// Mark a corpus file as changed in this slot
+        void
+        mark_changed(std::size_t file);
+
+        /// Mark all corpus files as changed in this slot
+        void
+        mark_all_changed();
+
+    private:
+        friend class temp_slots;
+
+        lease(temp_slots *slots, std::size_t index)
+            : slots_(slots), index_(index) {}
+
+        temp_slots *slots_{ nullptr };
+        std::size_t index_{ 0 };
+    };
+
+    /// Constructor
+    /**
+     * @param c Corpus of eligible files
+     * @param temp Directory where the slots are created
+     * @param n Number of slots
+     * @param allow_hardlinks Whether slot files might be hardlinks to the
+     * original files. This is only safe if clang-format replaces the files
+     * it formats instead of writing to them.
+     */
+    temp_slots(
+        const corpus &c,
+        const std::filesystem::path &temp,
+        std::size_t n,
+        bool allow_hardlinks);
+
+    /// Handler called with the lease of an acquired slot
+    using handler_type = std::function<void(lease)>;
+
+    /// Acquire a slot as soon as one is available
+    /**
+     * If a slot is available, the handler is called immediately. Otherwise,
+     * it is called by the thread releasing the next slot.
+     *
+     * The files in the slot are equal to the original files.
+     */
+    void
+    async_acquire(handler_type handler);
+
+private:
+    struct slot {
+        std::filesystem::path path;
+        bool initialized{ false };
+        bool all_changed{ false };
+        std::vector<std::size_t> changed;
+    };
+
+    // Restore the changed files and make the slot available again
+    void
+    release(std::size_t index);
+
+    // Hand the slot to the handler
+    void
+    handoff(std::size_t index, handler_type &handler);
+
+    // Copy the corpus files into a new slot
+    void
+    initialize(slot &s);
+
+    // Restore the original file to the slot
+    void
+    restore(slot &s, std::size_t file);
+
+    const corpus &corpus_;
+    bool allow_hardlinks_;
+    std::atomic<bool> reflink_supported_{ true };
+    std::vector<slot> slots_;
+    std::vector<std::size_t> available_;
+    std::deque<handler_type> waiting_;
+    std::mutex mutex_;
+};
+
+#endif // CLANG_UNFORMAT_TEMP_SLOTS_HPP
@@ -0,0 +1,87 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include "whitespace_distance.hpp"
+#include <levenshtein.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace {
+    // Runs longer than this are compared with edlib
+    constexpr std::size_t max_small_run_cells = 64 * 64;
+
+    bool
+    is_whitespace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v'
+               || c == '\f';
+    }
+
+    // Consume the whitespace run starting at i
+    std::string_view
+    whitespace_run(std::string_view s, std::size_t &i) {
+        std::size_t const begin = i;
+        while (i < s.size() && is_whitespace(s[i])) {
+            ++i;
+        }
+        return s.substr(begin, i - begin);
+    }
+
+    // Levenshtein distance between two whitespace runs
+    std::size_t
+    run_distance(
+        std::string_view r1,
+        std::string_view r2,
+        std::vector<std::size_t> &row) {
+        if (r1 == r2) {
+            return 0;
+        }
+        if (r1.empty() || r2.empty()) {
+            return (std::max)(r1.size(), r2.size());
+        }
+        if (r1.size() * r2.size() > max_small_run_cells) {
+            return levenshtein_distance(r1, r2);
+        }
+        row.resize(r2.size() + 1);
+        for (std::size_t j = 0; j < row.size(); ++j) {
+            row[j] = j;
+        }
+        for (std::size_t i = 1; i <= r1.size(); ++i) {
+            std::size_t diagonal = row[0];
+            row[0] = i;
+            for (std::size_t j = 1; j <= r2.size(); ++j) {
+                std::size_t const above = row[j];
+                row[j] = (std::min)(
+                    { above + 1,
+                      row[j - 1] + 1,
+                      diagonal + (r1[i - 1] != r2[j - 1]) });
+                diagonal = above;
+            }
+        }
+        return row[r2.size()];
+    }
+} // namespace
+
+std::optional<std::size_t>
+whitespace_distance(std::string_view s1, std::string_view s2) {
+    std::size_t distance = 0;
+    std::size_t i = 0;
+    std::size_t j = 0;
+    std::vector<std::size_t> row;
+    for (;;) {
+        std::string_view const r1 = whitespace_run(s1, i);
+        std::string_view const r2 = whitespace_run(s2, j);
+        distance += run_distance(r1, r2, row);
+        if (i == s1.size() && j == s2.size()) {
+            return distance;
+        }
+        if (i == s1.size() || j == s2.size() || s1[i] != s2[j]) {
+            return std::nullopt;
+        }
+        ++i;
+        ++j;
+    }
+}
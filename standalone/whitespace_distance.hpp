@@ -0,0 +1,31 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef CLANG_UNFORMAT_WHITESPACE_DISTANCE_HPP
+#define CLANG_UNFORMAT_WHITESPACE_DISTANCE_HPP
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+/// Distance between two strings that only differ in whitespace
+/**
+ * When the non-whitespace characters of both strings are the same, the
+ * distance is the sum of the Levenshtein distances between the whitespace
+ * runs around each of these characters. This takes linear time for the
+ * whitespace changes clang-format usually makes.
+ *
+ * The distance is an upper bound for the Levenshtein distance between
+ * the strings, and it's usually the same.
+ *
+ * @return The distance, or std::nullopt if the non-whitespace characters
+ * differ, as when clang-format sorts includes or reflows comments
+ */
+std::optional<std::size_t>
+whitespace_distance(std::string_view s1, std::string_view s2);
+
+#endif // CLANG_UNFORMAT_WHITESPACE_DISTANCE_HPP
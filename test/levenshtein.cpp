@@ -0,0 +1,250 @@
+//
+// Copyright (c) 2022 alandefreitas (alandefreitas@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// https://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <levenshtein.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+    // Quadratic Levenshtein distance the other implementations are checked
+    // against
+    std::size_t
+    reference_distance(std::string_view s1, std::string_view s2) {
+        std::vector<std::size_t> row(s2.size() + 1);
+        for (std::size_t j = 0; j <= s2.size(); ++j) {
+            row[j] = j;
+        }
+        for (std::size_t i = 1; i <= s1.size(); ++i) {
+            std::size_t diagonal = row[0];
+            row[0] = i;
+            for (std::size_t j = 1; j <= s2.size(); ++j) {
+                std::size_t const up = row[j];
+                row[j] = (std::min)(
+                    { up + 1,
+                      row[j - 1] + 1,
+                      diagonal + (s1[i - 1] != s2[j - 1] ? 1 : 0) });
+                diagonal = up;
+            }
+        }
+        return row[s2.size()];
+    }
+
+    // Random string with a few symbols, so strings share many characters
+    std::string
+    random_string(std::mt19937 &gen, std::size_t size, std::size_t symbols) {
+        std::string s;
+        for (std::size_t i = 0; i < size; ++i) {
+            s += static_cast<char>('a' + gen() % symbols);
+        }
+        return s;
+    }
+
+    // Apply a few random edits to a string
+    std::string
+    random_edits(std::mt19937 &gen, std::string s, std::size_t symbols) {
+        std::size_t const edits = gen() % 20;
+        for (std::size_t i = 0; i < edits; ++i) {
+            std::size_t const pos = s.empty() ? 0 : gen() % s.size();
+            char const c = static_cast<char>('a' + gen() % symbols);
+            switch (gen() % 3) {
+            case 0:
+                s.insert(s.begin() + pos, c);
+                break;
+            case 1:
+                if (!s.empty()) {
+                    s.erase(s.begin() + pos);
+                }
+                break;
+            default:
+                if (!s.empty()) {
+                    s[pos] = c;
+                }
+            }
+        }
+        return s;
+    }
+
+    // Random lines made of a few symbols
+    std::string
+    random_lines(std::mt19937 &gen, std::size_t size, std::size_t symbols) {
+        std::string s = random_string(gen, size, symbols);
+        for (char &c: s) {
+            if (gen() % 4 == 0) {
+                c = '\n';
+            }
+        }
+        return s;
+    }
+
+    // Lines that appear once in a string, so they anchor its alignment
+    std::string
+    unique_lines(std::size_t first, std::size_t count) {
+        std::string s;
+        for (std::size_t i = first; i < first + count; ++i) {
+            s += "line " + std::to_string(i) + "\n";
+        }
+        return s;
+    }
+
+    // Check the distances between two strings with bounds around the
+    // exact distance, where expected - 1 wraps to no bound for equal
+    // strings
+    bool
+    check_pair(
+        std::string const &original,
+        std::string const &candidate,
+        std::size_t expected) {
+        levenshtein_pattern const pattern(original);
+        std::size_t const bounds[] = { std::size_t(-1),
+                                       expected + 1,
+                                       expected,
+                                       expected - 1,
+                                       expected / 2 };
+        for (std::size_t bound: bounds) {
+            std::size_t const want = bound >= expected ? expected
+                                                       : std::size_t(-1);
+            std::size_t const pattern_d = pattern.distance(candidate, bound);
+            std::size_t const align_d = levenshtein_distance(
+                original,
+                candidate,
+                bound);
+            if (pattern_d != want || align_d != want) {
+                std::printf(
+                    "\"%.60s\" -> \"%.60s\" with bound %zu: expected %zu, "
+                    "pattern %zu, alignment %zu\n",
+                    original.c_str(),
+                    candidate.c_str(),
+                    bound,
+                    want,
+                    pattern_d,
+                    align_d);
+                return false;
+            }
+
+            // Small memory limits align large strings in windows, whose
+            // distances are flagged unless they are proven exact
+            for (std::size_t max_bytes: { std::size_t(1), std::size_t(16384) })
+            {
+                levenshtein_estimate const e = estimate_levenshtein_distance(
+                    original,
+                    candidate,
+                    bound,
+                    max_bytes,
+                    task_spawner{},
+                    1);
+                bool const valid = e.upper_bound
+                                       ? e.distance >= expected
+                                       : e.distance == want;
+                if (!valid) {
+                    std::printf(
+                        "\"%.60s\" -> \"%.60s\" with bound %zu and %zu "
+                        "bytes: expected %zu, estimate %zu%s\n",
+                        original.c_str(),
+                        candidate.c_str(),
+                        bound,
+                        max_bytes,
+                        want,
+                        e.distance,
+                        e.upper_bound ? " (upper bound)" : "");
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Check the distances between two short strings
+    bool
+    check_pair(std::string const &original, std::string const &candidate) {
+        return check_pair(
+            original,
+            candidate,
+            reference_distance(original, candidate));
+    }
+} // namespace
+
+int
+main() {
+    std::size_t failures = 0;
+
+    // A short original whose candidate is longer, with the bound equal to
+    // the distance
+    failures += !check_pair("a", "baaab");
+    failures += !check_pair("cbbbbbc", "abbcbbbbcacbcbcacbbcbaacaccbbcbcc");
+
+    std::mt19937 gen(42);
+    for (std::size_t i = 0; i < 5000 && failures < 10; ++i) {
+        std::size_t const symbols = 2 + gen() % 4;
+        std::string const original = random_string(
+            gen,
+            1 + gen() % (i % 3 == 0 ? 400 : 130),
+            symbols);
+        std::string const candidate
+            = i % 2 == 0 ? random_edits(gen, original, symbols)
+                         : random_string(gen, gen() % 300, symbols);
+        failures += !check_pair(original, candidate);
+    }
+
+    // Large strings are compared line by line. Equal text around two
+    // strings keeps their distance, so the reference only aligns the
+    // middle, where lines might cross the anchors.
+    std::string const prefix = unique_lines(0, 2500);
+    std::string const suffix = unique_lines(2500, 2500);
+    failures += !check_pair(
+        prefix + "x\ny\n" + suffix,
+        prefix + "y\nx\n" + suffix,
+        2);
+    levenshtein_estimate const swapped = estimate_levenshtein_distance(
+        prefix + "x\ny\n" + suffix,
+        prefix + "y\nx\n" + suffix,
+        std::size_t(-1),
+        16384,
+        task_spawner{},
+        1);
+    if (!swapped.upper_bound) {
+        std::printf("swapped lines in windows are not an upper bound\n");
+        ++failures;
+    }
+    for (std::size_t i = 0; i < 40 && failures < 10; ++i) {
+        std::size_t const symbols = 2 + gen() % 4;
+        std::string const original = random_lines(
+            gen,
+            1 + gen() % 200,
+            symbols);
+        std::string candidate;
+        if (i % 2 == 0) {
+            candidate = random_edits(gen, original, symbols);
+        } else {
+            // Reorder the lines of the original
+            std::vector<std::string> lines;
+            std::size_t begin = 0;
+            while (begin < original.size()) {
+                std::size_t end = original.find('\n', begin);
+                end = end == std::string::npos ? original.size() : end + 1;
+                lines.push_back(original.substr(begin, end - begin));
+                begin = end;
+            }
+            std::shuffle(lines.begin(), lines.end(), gen);
+            for (std::string const &line: lines) {
+                candidate += line;
+            }
+        }
+        failures += !check_pair(
+            prefix + original + suffix,
+            prefix + candidate + suffix,
+            reference_distance(original, candidate));
+    }
+    if (failures != 0) {
+        std::printf("%zu pairs failed\n", failures);
+        return 1;
+    }
+    return 0;
+}